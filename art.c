@@ -6,38 +6,98 @@
  * License - MIT
  */
 
+#define _POSIX_C_SOURCE 200112L
+
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
+#ifndef ART_NO_THREADS
+#include <pthread.h>
+#endif
+
+#ifndef ART_NO_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include "art.h"
 
 word_t bytes = 0;
 
+/* set on trees built by worker threads, which keep their byte count to
+ * themselves until they are spliced into a shared tree */
+#define ART_PRIVATE 0x100
+
+/* the reference bit of a node in an ART_CACHE tree */
+#define ART_USED(a, n) (*(word_t *)((byte_t *)(n) - (a)->ext))
+
 void*     artMalloc                (size_t);
-void      artNodeAddChild          (artNode**, artNode*, byte_t);
-void      artNodeReplaceChild      (artNode*, artNode*, byte_t);
-artNode*  artNodeGetChild          (artNode*, byte_t);
-void      artNodeRemoveChild       (artNode**, byte_t);
-void      artNodeResize            (artNode**, int);
-void*     artNodeAlloc             (int);
-void      artNodeFree              (artNode*);
+void      artNodeAddChild          (Art*, artNode**, artNode*, byte_t);
+void      artNodeReplaceChild      (Art*, artNode*, artNode*, byte_t);
+artNode*  artNodeGetChild          (Art*, artNode*, byte_t);
+void      artNodeRemoveChild       (Art*, artNode**, byte_t);
+void      artNodeResize            (Art*, artNode**, int);
+void*     artNodeAlloc             (Art*, int);
+size_t    artNodeSize              (int);
+void      artNodeFree              (Art*, artNode*);
 void      artWordToArray           (byte_t*, word_t); 
 word_t    artArrayToWord           (byte_t*);
+int       artWordFirstByte         (word_t);
+int       artMapFind               (byte_t*, artRef*, int, byte_t);
 void      artNodeMovePrefix        (artNode*, int);
 byte_t    artNodePrefixIdx         (artNode*, int);
 int       artNodeCheckPrefix       (artNode*, byte_t*, int, int);
 void      artNodeSetPrefix         (artNode*, byte_t*, int);
-void      artNodeMergeWithChild    (artNode**);
+void      artNodeMergeWithChild    (Art*, artNode**);
 byte_t*   artNodeGetPrefix         (artNode*); 
-void      artNodeSetVal            (artNode**, word_t);
+void      artNodeSetVal            (Art*, artNode**, word_t);
+void      artNodeRebuild           (Art*, artNode**);
 void      artNodeCopyPrefix        (artNode*, artNode*);
 word_t    artNodeGetVal            (artNode*);
-artNode*  artGetNode               (Art*, byte_t*, int, int); 
-void      __artGetWithPrefix       (artNode*, artVal*, byte_t*, int);
+word_t    __artPut                 (Art*, byte_t*, int, word_t);
+int       __artRemove              (Art*, byte_t*, int, int);
+artPosting* artPostingResize       (artPosting*, int);
+int       artNodeChildren          (Art*, artNode*, byte_t*, artNode**);
+artNode*  artNodeNextChild         (Art*, artNode*, int, byte_t*);
+int       __artWalk                (Art*, artNode*, int, byte_t*, int, artVisitor, void*);
+int       artCollectVisitor        (void*, byte_t*, int, word_t);
+int       __artFuzzy               (Art*, artNode*, byte_t*, int, int*, byte_t*, int, int, artVisitor, void*);
+int       __artIntersect           (Art*, artNode*, int, Art*, artNode*, int, byte_t*, int, artJoinVisitor, void*);
+int       __artDifference          (Art*, artNode*, int, Art*, artNode*, int, byte_t*, int, artVisitor, void*);
+artNode*  artGetNode               (Art*, byte_t*, int, int*); 
+void      artNodeRescore           (Art*, artNode*);
+void      artScorePath             (Art*, byte_t*, int);
+void      artMerklePath            (Art*, byte_t*, int, word_t, word_t);
+word_t*   artBufferFind            (artBuffer*, byte_t*, int);
+void      artBufferPut             (Art*, byte_t*, int, word_t, int);
+void      artFilterAdd             (artFilter*, byte_t*, int, int);
+int       artFilterHas             (artFilter*, byte_t*, int);
+void      artFeedAppend            (artFeed*, int, byte_t*, int, word_t);
+void      artCacheEvict            (Art*, byte_t*, int);
 
 void artNodePrintDetails (artNode*);
 
+#ifdef ART_COMPACT
+#define ART_CHUNK_BITS  17
+#define ART_CHUNK_UNITS ((word_t)1 << ART_CHUNK_BITS)
+#define ART_CHUNK_SIZE  (ART_CHUNK_UNITS << 3)
+#define ART_MAX_CHUNKS  ((word_t)1 << (32 - ART_CHUNK_BITS))
+
+#define ART_NODE(a, r)  ((r) ? (artNode *)((a)->arena->chunks[(r) >> ART_CHUNK_BITS] \
+                          + (((r) & (ART_CHUNK_UNITS - 1)) << 3)) : NULL)
+#define ART_REF(a, n)   artArenaRef((artNode *)(n))
+
+artRef    artArenaRef              (artNode*);
+void*     artArenaAlloc            (artArena*, int, size_t);
+void      artArenaRelease          (artArena*, void*, int);
+#else
+#define ART_NODE(a, r)  ((artNode *)(r))
+#define ART_REF(a, n)   ((artRef)(n))
+#endif
+
 void* artMalloc (size_t size) {
   void* buf = malloc(size);
   word_t b = (word_t)buf;
@@ -49,37 +109,242 @@ void* artMalloc (size_t size) {
   return buf;
 }
 
-void artWordToArray (byte_t* b, word_t w) {
-  int idx, i, s = (sizeof(word_t) * 8);
-  for (i = 8; i <= s; i += 8) {
-    idx = (i/8) - 1;
-    b[idx] = (w >> (s - i)) & 0xff;
+/* word-at-a-time helpers
+ *   prefixes and child maps are compared a machine word at a time.
+ *   loads go through memcpy so unaligned keys are fine on every target,
+ *   and the compiler reduces them to a single native load. */
+
+#define ART_WORD  ((int)sizeof(word_t))
+#define ART_ONES  (~(word_t)0 / 0xff)
+#define ART_HIGHS (ART_ONES * 0x80)
+
+static int artLittleEndian (void) {
+  word_t one = 1;
+  return *(byte_t *)&one == 1;
+}
+
+/* index, in memory order, of the first non-zero byte of a non-zero word */
+int artWordFirstByte (word_t x) {
+#if defined(__GNUC__)
+  if (artLittleEndian())
+    return __builtin_ctzl(x) >> 3;
+  return __builtin_clzl(x) >> 3;
+#else
+  byte_t b[sizeof(word_t)];
+  int i;
+  memcpy(b, &x, ART_WORD);
+  for (i = 0; i < ART_WORD && !b[i]; i++);
+  return i;
+#endif
+}
+
+#ifdef ART_COMPACT
+/* arena
+ *   chunks are aligned to their size so the owning chunk of a node is
+ *   found by masking its address. the first two units of every chunk
+ *   hold the chunk's index and the address malloc returned for it. */
+
+static int artNodeClass (int type) {
+  switch (type) {
+    case _LEAF:     return 0;
+    case _SINGLE:   return 1;
+    case _INNER:    return 2;
+    case _LINEAR:   return 3;
+    case _LINEAR16: return 4;
+    case _SPAN:     return 5;
+    case _INNER16:  return 7;
+    case _INNER48:  return 8;
+    default:        return 6;
   }
 }
 
-word_t artArrayToWord (byte_t* b) {
-  int idx, i, s = (sizeof(word_t) * 8);
-  word_t w = 0, n;
-  for (i = 8; i <= s; i += 8) {
-    idx = (i/8) - 1;
-    n = (word_t)b[idx];
-    w |= (n << (s - i));
+typedef struct {
+  byte_t**        chunks;
+  int             nchunks;
+#ifndef ART_NO_THREADS
+  pthread_mutex_t lock;
+#endif
+} artChunkTable;
+
+/* the chunk table is allocated at its full size and never moves, so
+ * arenas sharing it may add chunks while others resolve references. */
+struct artArena {
+  byte_t**       chunks;
+  artChunkTable* table;
+  byte_t*        chunk;
+  word_t         used;
+  void*          free[9];
+};
+
+static artArena* artArenaNew (artChunkTable* t) {
+  artArena* a = artMalloc(sizeof(artArena));
+  if (!t) {
+    t = artMalloc(sizeof(artChunkTable));
+    t->chunks = calloc(ART_MAX_CHUNKS, sizeof(byte_t*));
+    if (!t->chunks) {
+      fprintf(stderr, "Fatal: out of memory.");
+      abort();
+    }
+#ifndef ART_NO_THREADS
+    pthread_mutex_init(&t->lock, NULL);
+#endif
+  }
+  a->table = t;
+  a->chunks = t->chunks;
+  return a;
+}
+
+static void artArenaGrow (artArena* a) {
+  artChunkTable* t = a->table;
+  byte_t *raw, *base;
+  word_t idx;
+  raw = malloc(ART_CHUNK_SIZE * 2);
+  if (!raw) {
+    fprintf(stderr, "Fatal: out of memory.");
+    abort();
+  }
+#ifndef ART_NO_THREADS
+  pthread_mutex_lock(&t->lock);
+#endif
+  idx = (word_t)t->nchunks++;
+#ifndef ART_NO_THREADS
+  pthread_mutex_unlock(&t->lock);
+#endif
+  if (idx >= ART_MAX_CHUNKS) {
+    fprintf(stderr, "Fatal: arena exhausted.");
+    abort();
+  }
+  base = raw + (ART_CHUNK_SIZE - ((word_t)raw & (ART_CHUNK_SIZE - 1)));
+  memset(base, 0, ART_CHUNK_SIZE);
+  ((word_t *)base)[0] = idx;
+  ((byte_t **)base)[1] = raw;
+  t->chunks[idx] = base;
+  a->chunk = base;
+  a->used = 2;
+}
+
+artRef artArenaRef (artNode* n) {
+  byte_t* base;
+  if (!n) return 0;
+  base = (byte_t *)((word_t)n & ~(ART_CHUNK_SIZE - 1));
+  return (artRef)((((word_t *)base)[0] << ART_CHUNK_BITS)
+    | (((byte_t *)n - base) >> 3));
+}
+
+void* artArenaAlloc (artArena* a, int type, size_t s) {
+  int c = artNodeClass(type);
+  word_t u = (s + 7) >> 3;
+  byte_t* d = a->free[c];
+  if (d) {
+    a->free[c] = *(void **)d;
+    memset(d, 0, s);
+    return d;
   }
+  if (!a->chunk || a->used + u > ART_CHUNK_UNITS)
+    artArenaGrow(a);
+  d = a->chunk + (a->used << 3);
+  a->used += u;
+  return d;
+}
+
+void artArenaRelease (artArena* a, void* d, int type) {
+  int c = artNodeClass(type);
+  *(void **)d = a->free[c];
+  a->free[c] = d;
+}
+#endif
+
+void artWordToArray (byte_t* b, word_t w) {
+  memcpy(b, &w, ART_WORD);
+}
+
+word_t artArrayToWord (byte_t* b) {
+  word_t w;
+  memcpy(&w, b, ART_WORD);
   return w;
 }
 
 int artNodeCheckPrefix (artNode* n, byte_t* k, int l, int d) {
-  int i, j = 0;
+  int j = 0, m = n->head.plen;
   byte_t* k0;
-  if (n->head.plen > sizeof(word_t))
+  word_t x;
+  if (m > ART_WORD)
     k0 = (byte_t *)artArrayToWord(n->head.path);
   else k0 = n->head.path;
-  for (i = d; j < n->head.plen && i < l; i++, j++) {
-    if (k0[j] != k[i]) break;
+  if (m > l - d) m = l - d;
+  k += d;
+  for (; j + ART_WORD <= m; j += ART_WORD) {
+    x = artArrayToWord(k0 + j) ^ artArrayToWord(k + j);
+    if (x) return j + artWordFirstByte(x);
+  }
+  for (; j < m; j++) {
+    if (k0[j] != k[j]) break;
   }
   return j;
 }
 
+/* finds b in a linear child map. empty slots hold map 0 with no child,
+ * so a hit is only accepted when the slot is occupied. */
+int artMapFind (byte_t* map, artRef* radix, int n, byte_t b) {
+  word_t x, t, bb = ART_ONES * b;
+  int i = 0, j;
+  for (; i + ART_WORD <= n; i += ART_WORD) {
+    x = artArrayToWord(map + i) ^ bb;
+    t = (x - ART_ONES) & ~x & ART_HIGHS;
+    if (t) {
+      j = i + artWordFirstByte(t);
+      if (map[j] == b && radix[j]) return j;
+      for (i = j + 1; i < n; i++)
+        if (map[i] == b && radix[i]) return i;
+      return -1;
+    }
+  }
+  for (; i < n; i++)
+    if (map[i] == b && radix[i]) return i;
+  return -1;
+}
+
+/* span maps
+ *   a span node's children sit in key order, so the slot of key byte b
+ *   is the number of bits set below b in the node's bitmap. */
+
+#define ART_BITS (8 * ART_WORD)
+
+static int artWordCount (word_t x) {
+#if defined(__GNUC__)
+  return __builtin_popcountl(x);
+#else
+  int c = 0;
+  for (; x; x &= x - 1) c++;
+  return c;
+#endif
+}
+
+static int artSpanHas (artNodeSpan* s, int b) {
+  return (int)(s->bits[b / ART_BITS] >> (b % ART_BITS) & 1);
+}
+
+static int artSpanRank (artNodeSpan* s, int b) {
+  int i, w = b / ART_BITS, c = 0;
+  for (i = 0; i < w; i++)
+    c += artWordCount(s->bits[i]);
+  return c + artWordCount(s->bits[w] & (((word_t)1 << (b % ART_BITS)) - 1));
+}
+
+/* slot of b, or -1 when b has no child */
+static int artSpanFind (artNodeSpan* s, int b) {
+  return artSpanHas(s, b) ? artSpanRank(s, b) : -1;
+}
+
+/* marks b and opens its slot, keeping the children in key order */
+static void artSpanInsert (artNodeSpan* s, int b, artRef r) {
+  int i = artSpanRank(s, b);
+  memmove(s->radix + i + 1, s->radix + i, (s->head.rcnt - i) * sizeof(artRef));
+  s->radix[i] = r;
+  s->bits[b / ART_BITS] |= (word_t)1 << (b % ART_BITS);
+  s->head.rcnt += 1;
+}
+
 byte_t artNodePrefixIdx (artNode* n, int idx) {
   byte_t* k0;
   if (n->head.plen > sizeof(word_t))
@@ -121,7 +386,7 @@ void artNodeMovePrefix (artNode* n, int i) {
       free(p);
     }
   } else {
-    memcpy(n->head.path, n->head.path + i, f);
+    memmove(n->head.path, n->head.path + i, f);
   }
   n->head.plen = f;
 }
@@ -135,7 +400,7 @@ byte_t* artNodeGetPrefix (artNode* n) {
   return p;
 }
 
-void artNodeMergeWithChild (artNode** n0) {
+void artNodeMergeWithChild (Art* art, artNode** n0) {
   artNodeSingle *pck;
   artNode* n1;
   byte_t* p;
@@ -145,13 +410,14 @@ void artNodeMergeWithChild (artNode** n0) {
     return;
 
   pck = (artNodeSingle *)*n0;
-  n1 = (artNode *)pck->radix;
+  n1 = ART_NODE(art, pck->radix);
   l = pck->head.plen + n1->head.plen;
   p = artMalloc(l);
   memcpy(p, artNodeGetPrefix(*n0), pck->head.plen);
   memcpy(p + pck->head.plen, artNodeGetPrefix(n1), n1->head.plen);
   artNodeSetPrefix(n1, p, l);
-  artNodeFree(*n0);
+  free(p);
+  artNodeFree(art, *n0);
   *n0 = n1;
 }
 
@@ -159,8 +425,7 @@ void artNodeCopyPrefix (artNode* n0, artNode* n1) {
   artNodeSetPrefix(n0, artNodeGetPrefix(n1), n1->head.plen);
 }
 
-void* artNodeAlloc (int type) {
-  artNode* d;
+size_t artNodeSize (int type) {
   size_t s = 0;
   switch (type) {
     case _LEAF:  
@@ -178,59 +443,57 @@ void* artNodeAlloc (int type) {
     case _LINEAR16: 
       s = sizeof(artNodeLinear16);
     break;
+    case _INNER16:
+      s = sizeof(artNodeInner16);
+    break;
     case _SPAN: 
       s = sizeof(artNodeSpan);
     break;
+    case _INNER48:
+      s = sizeof(artNodeInner48);
+    break;
     case _RADIX:
       s = sizeof(artNodeRadix);
     break;
     default: break;
   }
-  bytes += s;
-  d = (artNode *)artMalloc(s);
-  d->head.type = type;
+#ifdef ART_COMPACT
+  s = (s + 7) & ~(size_t)7;
+#endif
+  return s;
+}
+
+void* artNodeAlloc (Art* art, int type) {
+  byte_t* d;
+  size_t s = artNodeSize(type) + art->ext;
+  art->version++;
+  art->bytes += s;
+  if (!(art->flags & ART_PRIVATE)) bytes += s;
+#ifdef ART_COMPACT
+  d = (byte_t *)artArenaAlloc(art->arena, type, s) + art->ext;
+#else
+  d = (byte_t *)artMalloc(s) + art->ext;
+#endif
+  ((artNode *)d)->head.type = type;
   return (void *)d;
 }
 
-void artNodeFree (artNode* n) {
+void artNodeFree (Art* art, artNode* n) {
+  size_t s = artNodeSize(n->head.type) + art->ext;
   if (n->head.plen > sizeof(word_t)) {
     free((void *)artArrayToWord(n->head.path));
   }
-
-  switch (n->head.type) {
-    case _LEAF:
-      bytes -= sizeof(artNodeLeaf);
-      free((artNodeLeaf *)n);
-    break;
-    case _SINGLE:
-      bytes -= sizeof(artNodeSingle);
-      free((artNodeSingle *)n);
-    break;
-    case _INNER:
-      bytes -= sizeof(artNodeInner);
-      free((artNodeInner *)n);
-    break;
-    case _LINEAR:
-      bytes -= sizeof(artNodeLinear);
-      free((artNodeLinear *)n);
-    break;
-    case _LINEAR16:
-      bytes -= sizeof(artNodeLinear16);
-      free((artNodeLinear16 *)n);
-    break;
-    case _SPAN:
-      bytes -= sizeof(artNodeSpan);
-      free((artNodeSpan *)n);
-    break;
-    case _RADIX:
-      bytes -= sizeof(artNodeRadix);
-      free((artNodeRadix *)n);
-    break;
-    default:  break;
-  }
+  art->version++;
+  art->bytes -= s;
+  if (!(art->flags & ART_PRIVATE)) bytes -= s;
+#ifdef ART_COMPACT
+  artArenaRelease(art->arena, (byte_t *)n - art->ext, n->head.type);
+#else
+  free((byte_t *)n - art->ext);
+#endif
 }
 
-artNode* artNodeGetChild (artNode* n, byte_t b) {
+artNode* artNodeGetChild (Art* art, artNode* n, byte_t b) {
   artNodeSingle* p;
   artNodeLinear* l;
   artNodeLinear16* l16;
@@ -246,37 +509,30 @@ artNode* artNodeGetChild (artNode* n, byte_t b) {
   case _SINGLE:
     p = (artNodeSingle *)n;
     if (p->map == b) {
-      ret = (artNode *)p->radix;
+      ret = ART_NODE(art, p->radix);
     }
   break;
   case _INNER:
   case _LINEAR:
     l = (artNodeLinear *)n;
-    for (i = 0; i < _LINEAR; i++) {
-      if (l->map[i] == b) {
-        ret = (artNode *)l->radix[i];
-        break;
-      }
-    }
+    i = artMapFind(l->map, l->radix, _LINEAR, b);
+    if (i >= 0) ret = ART_NODE(art, l->radix[i]);
   break;
   case _LINEAR16:
+  case _INNER16:
     l16 = (artNodeLinear16 *)n;
-    for (i = 0; i < _LINEAR16; i++) {
-      if (l16->map[i] == b) {
-        ret = (artNode *)l16->radix[i];
-        break;
-      }
-    }
+    i = artMapFind(l16->map, l16->radix, _LINEAR16, b);
+    if (i >= 0) ret = ART_NODE(art, l16->radix[i]);
   break;
   case _SPAN: 
+  case _INNER48:
     s = (artNodeSpan *)n;
-    if (s->map[b] != _SPAN) {
-      ret = (artNode *)s->radix[s->map[b]];
-    }
+    i = artSpanFind(s, b);
+    if (i >= 0) ret = ART_NODE(art, s->radix[i]);
   break;
   case _RADIX: 
     r = (artNodeRadix *)n;
-    ret = (artNode *)r->radix[b];
+    ret = ART_NODE(art, r->radix[b]);
   break;
   default: break;
   }
@@ -284,7 +540,7 @@ artNode* artNodeGetChild (artNode* n, byte_t b) {
   return ret;
 }
 
-void artNodeResize (artNode** n, int grow) {
+void artNodeResize (Art* art, artNode** n, int grow) {
   artNodeSingle* p;
   artNodeLinear* l;
   artNodeInner* in;
@@ -293,47 +549,48 @@ void artNodeResize (artNode** n, int grow) {
   artNodeRadix* r;
   artNodeLeaf* k;
   byte_t type;
+  word_t v;
 
   type = (*n)->head.type;
 
   switch (type) {
   case _LEAF:
     k = (artNodeLeaf *)*n;
-    p = (artNodeSingle *)artNodeAlloc(_SINGLE);
+    p = (artNodeSingle *)artNodeAlloc(art, _SINGLE);
     p->head.type = _SINGLE;
     p->val = k->val;
     artNodeCopyPrefix((artNode *)p, *n);
-    artNodeFree(*n);
+    artNodeFree(art, *n);
     *n = (artNode *)p;
   break;
   case _SINGLE:
     p = (artNodeSingle *)*n;
     if (grow && p->val) {
-      l = (artNodeLinear *)artNodeAlloc(_LINEAR);
+      l = (artNodeLinear *)artNodeAlloc(art, _LINEAR);
       l->head.type = _LINEAR;
       l->map[0] = p->map;
       l->radix[0] = p->radix;
       l->val = p->val;
       l->head.rcnt = p->head.rcnt;
       artNodeCopyPrefix((artNode *)l, *n);
-      artNodeFree(*n);
+      artNodeFree(art, *n);
       *n = (artNode *)l;
     } else if (grow) {
-      in = (artNodeInner *)artNodeAlloc(_INNER);
+      in = (artNodeInner *)artNodeAlloc(art, _INNER);
       in->head.type = _INNER;
       in->map[0] = p->map;
       in->radix[0] = p->radix;
       in->head.rcnt = p->head.rcnt;
       artNodeCopyPrefix((artNode *)in, *n);
-      artNodeFree(*n);
+      artNodeFree(art, *n);
       *n = (artNode *)in;
     } else {
-      k = (artNodeLeaf *)artNodeAlloc(_LEAF);
+      k = (artNodeLeaf *)artNodeAlloc(art, _LEAF);
       k->head.type = _LEAF;
       k->val = p->val;
       k->head.rcnt = p->head.rcnt;
       artNodeCopyPrefix((artNode *)k, *n);
-      artNodeFree(*n);
+      artNodeFree(art, *n);
       *n = (artNode *)k;
     }
   break;
@@ -341,21 +598,19 @@ void artNodeResize (artNode** n, int grow) {
     if (grow) {
       int i;
       in = (artNodeInner *)*n;
-      l16 = (artNodeLinear16 *)artNodeAlloc(_LINEAR16);
-      l16->head.type = _LINEAR16;
+      l16 = (artNodeLinear16 *)artNodeAlloc(art, _INNER16);
       for (i = 0; i < _LINEAR; i++) {
         l16->map[i] = in->map[i];
         l16->radix[i] = in->radix[i];
       }
-      l16->val = (word_t)0;
       l16->head.rcnt = in->head.rcnt;
       artNodeCopyPrefix((artNode *)l16, *n);
-      artNodeFree(*n);
+      artNodeFree(art, *n);
       *n = (artNode *)l16;
     } else {
       int i;
       in = (artNodeInner *)*n;
-      p = (artNodeSingle *)artNodeAlloc(_SINGLE);
+      p = (artNodeSingle *)artNodeAlloc(art, _SINGLE);
       p->head.type = _SINGLE;
       for (i = 0; i < _LINEAR; i++) {
         if (in->radix[i]) {
@@ -367,7 +622,7 @@ void artNodeResize (artNode** n, int grow) {
       p->val = (word_t)0;
       p->head.rcnt = in->head.rcnt;
       artNodeCopyPrefix((artNode *)p, *n);
-      artNodeFree(*n);
+      artNodeFree(art, *n);
       *n = (artNode *)p;
     }
   break;
@@ -375,7 +630,7 @@ void artNodeResize (artNode** n, int grow) {
     if (grow) {
       int i;
       l = (artNodeLinear *)*n;
-      l16 = (artNodeLinear16 *)artNodeAlloc(_LINEAR16);
+      l16 = (artNodeLinear16 *)artNodeAlloc(art, _LINEAR16);
       l16->head.type = _LINEAR16;
       for (i = 0; i < _LINEAR; i++) {
         l16->map[i] = l->map[i];
@@ -384,12 +639,12 @@ void artNodeResize (artNode** n, int grow) {
       l16->val = l->val;
       l16->head.rcnt = l->head.rcnt;
       artNodeCopyPrefix((artNode *)l16, *n);
-      artNodeFree(*n);
+      artNodeFree(art, *n);
       *n = (artNode *)l16;
     } else {
       int i;
       l = (artNodeLinear *)*n;
-      p = (artNodeSingle *)artNodeAlloc(_SINGLE);
+      p = (artNodeSingle *)artNodeAlloc(art, _SINGLE);
       p->head.type = _SINGLE;
       for (i = 0; i < _LINEAR; i++) {
         if (l->radix[i]) {
@@ -401,30 +656,28 @@ void artNodeResize (artNode** n, int grow) {
       p->val = l->val;
       p->head.rcnt = l->head.rcnt;
       artNodeCopyPrefix((artNode *)p, *n);
-      artNodeFree(*n);
+      artNodeFree(art, *n);
       *n = (artNode *)p;
     }
   break;
+  /* the inner types share their valued layout up to the value, so one
+   * pointer type serves both as long as val is left alone */
   case _LINEAR16:
+  case _INNER16:
     l16 = (artNodeLinear16 *)*n;
+    v = type == _LINEAR16 ? l16->val : 0;
     if (grow) {
       int i;
-      l16 = (artNodeLinear16 *)*n;
-      s = (artNodeSpan *)artNodeAlloc(_SPAN);
-      s->head.type = _SPAN;
-      for (i = 0; i < 256; i++) s->map[i] = _SPAN;
-      for (i = 0; i < _LINEAR16; i++) {
-        s->map[l16->map[i]] = i;
-        s->radix[i] = l16->radix[i];
-      }
-      s->val = l16->val;
-      s->head.rcnt = l16->head.rcnt;
+      s = (artNodeSpan *)artNodeAlloc(art, v ? _SPAN : _INNER48);
+      for (i = 0; i < _LINEAR16; i++)
+        artSpanInsert(s, l16->map[i], l16->radix[i]);
+      if (v) s->val = v;
       artNodeCopyPrefix((artNode *)s, *n);
-      artNodeFree(*n);
+      artNodeFree(art, *n);
       *n = (artNode *)s;
-    } else if (!l16->val) {
+    } else if (!v) {
       int i, j = 0;
-      in = (artNodeInner *)artNodeAlloc(_INNER);
+      in = (artNodeInner *)artNodeAlloc(art, _INNER);
       in->head.type = _INNER;
       for (i = 0; i < _LINEAR16; i++) {
         if (l16->radix[i]) {
@@ -434,11 +687,11 @@ void artNodeResize (artNode** n, int grow) {
       }
       in->head.rcnt = l16->head.rcnt;
       artNodeCopyPrefix((artNode *)in, *n);
-      artNodeFree(*n);
+      artNodeFree(art, *n);
       *n = (artNode *)in;
     } else {
       int i, j = 0;
-      l = (artNodeLinear *)artNodeAlloc(_LINEAR);
+      l = (artNodeLinear *)artNodeAlloc(art, _LINEAR);
       l->head.type = _LINEAR;
       for (i = 0; i < _LINEAR16; i++) {
         if (l16->radix[i]) {
@@ -446,70 +699,68 @@ void artNodeResize (artNode** n, int grow) {
           l->radix[j++] = l16->radix[i];
         }
       }
-      l->val = l16->val;
+      l->val = v;
       l->head.rcnt = l16->head.rcnt;
       artNodeCopyPrefix((artNode *)l, *n);
-      artNodeFree(*n);
+      artNodeFree(art, *n);
       *n = (artNode *)l;
     }
   break;
   case _SPAN:
+  case _INNER48:
+    s = (artNodeSpan *)*n;
+    v = type == _SPAN ? s->val : 0;
     if (grow) {
-      int i;
-      s = (artNodeSpan *)*n;
-      r = (artNodeRadix *)artNodeAlloc(_RADIX);
+      int i, j;
+      r = (artNodeRadix *)artNodeAlloc(art, _RADIX);
       r->head.type = _RADIX;
-      for (i = 0; i < 256; i++) {
-        if (s->map[i] != _SPAN) {
-          r->radix[i] = s->radix[s->map[i]];
-        }
+      for (i = 0, j = 0; i < 256; i++) {
+        if (artSpanHas(s, i))
+          r->radix[i] = s->radix[j++];
       }
-      r->val = s->val;
+      r->val = v;
       r->head.rcnt = s->head.rcnt;
       artNodeCopyPrefix((artNode *)r, *n);
-      artNodeFree(*n);
+      artNodeFree(art, *n);
       *n = (artNode *)r;
     } else {
       int i, j = 0;
-      s = (artNodeSpan *)*n;
-      l16 = (artNodeLinear16 *)artNodeAlloc(_LINEAR16);
-      l16->head.type = _LINEAR16;
+      l16 = (artNodeLinear16 *)artNodeAlloc(art, v ? _LINEAR16 : _INNER16);
       for (i = 0; i < 256; i++) {
-        if (s->map[i] != _SPAN) {
+        if (artSpanHas(s, i)) {
           l16->map[j] = (byte_t)i;
-          l16->radix[j++] = s->radix[s->map[i]];
+          l16->radix[j] = s->radix[j];
+          j++;
         }
       }
-      l16->val = s->val;
+      if (v) l16->val = v;
       l16->head.rcnt = s->head.rcnt;
       artNodeCopyPrefix((artNode *)l16, *n);
-      artNodeFree(*n);
+      artNodeFree(art, *n);
       *n = (artNode *)l16;
     }
   break;
   case _RADIX: {
     int i, j = 0;
     r = (artNodeRadix *)*n;
-    s = (artNodeSpan *)artNodeAlloc(_SPAN);
-    s->head.type = _SPAN;
-    for (i = 0; i < 256; i++) s->map[i] = _SPAN;
+    s = (artNodeSpan *)artNodeAlloc(art, r->val ? _SPAN : _INNER48);
     for (i = 0; i < 256; i++) {
       if (r->radix[i]) {
-        s->map[i] = j;
+        s->bits[i / ART_BITS] |= (word_t)1 << (i % ART_BITS);
         s->radix[j++] = r->radix[i];
       }
     }
-    s->val = r->val;
+    if (r->val) s->val = r->val;
     s->head.rcnt = r->head.rcnt;
     artNodeCopyPrefix((artNode *)s, *n);
-    artNodeFree(*n);
+    artNodeFree(art, *n);
     *n = (artNode *)s;
   } break;
   default:  break;
   }
 }
 
-void artNodeRemoveChild (artNode** n, byte_t b) {
+void artNodeRemoveChild (Art* art, artNode** n, byte_t b) {
   artNodeSingle* p;
   artNodeLinear* l;
   artNodeLinear16* l16;
@@ -525,7 +776,9 @@ void artNodeRemoveChild (artNode** n, byte_t b) {
     case _INNER:    rl = _SINGLE;   break;
     case _LINEAR:   rl = _SINGLE;   break;
     case _LINEAR16: rl = _LINEAR;   break;
+    case _INNER16:  rl = _LINEAR;   break;
     case _SPAN:     rl = _LINEAR16; break;
+    case _INNER48:  rl = _LINEAR16; break;
     case _RADIX:    rl = _SPAN;     break;
   }
 
@@ -533,55 +786,56 @@ void artNodeRemoveChild (artNode** n, byte_t b) {
   case _SINGLE: 
     p = (artNodeSingle *)*n;
     if (p->map == b) {
-      p->radix = (word_t)0;
+      p->radix = 0;
       p->head.rcnt = 0;
     }
   break;
   case _INNER:
   case _LINEAR:
     l = (artNodeLinear *)*n;
-    for (i = 0; i < _LINEAR; i++) {
-      if (l->map[i] == b && l->radix[i]) {
-        l->map[i] = (byte_t)0;
-        l->radix[i] = (word_t)0;
-        l->head.rcnt -= 1;
-        break;
-      }
+    i = artMapFind(l->map, l->radix, _LINEAR, b);
+    if (i >= 0) {
+      l->map[i] = (byte_t)0;
+      l->radix[i] = 0;
+      l->head.rcnt -= 1;
     }
   break;
   case _LINEAR16:
+  case _INNER16:
     l16 = (artNodeLinear16 *)*n;
-    for (i = 0; i < _LINEAR16; i++) {
-      if (l16->map[i] == b && l16->radix[i]) {
-        l16->map[i] = (byte_t)0;
-        l16->radix[i] = (word_t)0;
-        l16->head.rcnt -= 1;
-        break;
-      }
+    i = artMapFind(l16->map, l16->radix, _LINEAR16, b);
+    if (i >= 0) {
+      l16->map[i] = (byte_t)0;
+      l16->radix[i] = 0;
+      l16->head.rcnt -= 1;
     }
   break;
   case _SPAN:
+  case _INNER48:
     s = (artNodeSpan *)*n;
-    if (s->map[b] != _SPAN) {
-      s->radix[s->map[b]] = (word_t)0;
-      s->map[b] = _SPAN;
+    i = artSpanFind(s, b);
+    if (i >= 0) {
+      memmove(s->radix + i, s->radix + i + 1,
+        (s->head.rcnt - i - 1) * sizeof(artRef));
+      s->radix[s->head.rcnt - 1] = 0;
+      s->bits[b / ART_BITS] &= ~((word_t)1 << (b % ART_BITS));
       s->head.rcnt -= 1;
     }
   break;
   case _RADIX: 
     r = (artNodeRadix *)*n;
-    r->radix[b] = (word_t)0;
+    r->radix[b] = 0;
     r->head.rcnt -= 1;
   break;
   default: break;
   }
 
   if (rl > -1 && (*n)->head.rcnt == rl) {
-    artNodeResize(n, 0);
+    artNodeResize(art, n, 0);
   }
 }
 
-void artNodeReplaceChild (artNode* n, artNode* c, byte_t b) {
+void artNodeReplaceChild (Art* art, artNode* n, artNode* c, byte_t b) {
   artNodeSingle* p;
   artNodeLinear* l;
   artNodeLinear16* l16;
@@ -595,45 +849,51 @@ void artNodeReplaceChild (artNode* n, artNode* c, byte_t b) {
   case _SINGLE:
     p = (artNodeSingle *)n;
     if (p->map == b) {
-      p->radix = (word_t)c;
+      p->radix = ART_REF(art, c);
     }
   break;
   case _INNER:
   case _LINEAR: {
     int i;
     l = (artNodeLinear *)n;
-    for (i = 0; i < _LINEAR; i++) {
-      if (l->map[i] == b) {
-        l->radix[i] = (word_t)c;
-        break;
-      }
-    }
+    i = artMapFind(l->map, l->radix, _LINEAR, b);
+    if (i >= 0) l->radix[i] = ART_REF(art, c);
   } break;
-  case _LINEAR16: {
+  case _LINEAR16:
+  case _INNER16: {
     int i;
     l16 = (artNodeLinear16 *)n;
-    for (i = 0; i < _LINEAR16; i++) {
-      if (l16->map[i] == b) {
-        l16->radix[i] = (word_t)c;
-        break;
-      }
-    }
+    i = artMapFind(l16->map, l16->radix, _LINEAR16, b);
+    if (i >= 0) l16->radix[i] = ART_REF(art, c);
   } break;
   case _SPAN:
+  case _INNER48: {
+    int i;
     s = (artNodeSpan *)n;
-    if (s->map[b] != _SPAN)
-      s->radix[s->map[b]] = (word_t)c;
-  break;
+    i = artSpanFind(s, b);
+    if (i >= 0) s->radix[i] = ART_REF(art, c);
+  } break;
   case _RADIX:
     r = (artNodeRadix *)n;
     if (r->radix[b])
-      r->radix[b] = (word_t)c;
+      r->radix[b] = ART_REF(art, c);
   break;
   default: break;
   }
 }
 
-void artNodeAddChild (artNode** n, artNode* c, byte_t b) {
+/* children a node type holds. the inner types round up from their
+ * valued layout's type number. */
+static int artNodeCap (int type) {
+  switch (type) {
+    case _INNER:   return _LINEAR;
+    case _INNER16: return _LINEAR16;
+    case _INNER48: return _SPAN;
+    default:       return type;
+  }
+}
+
+void artNodeAddChild (Art* art, artNode** n, artNode* c, byte_t b) {
   artNodeSingle* p;
   artNodeLinear* l;
   artNodeLinear16* l16;
@@ -643,9 +903,8 @@ void artNodeAddChild (artNode** n, artNode* c, byte_t b) {
 
   type = (*n)->head.type;
 
-  if ((type != _RADIX && type == (*n)->head.rcnt)
-    || (type == _INNER && (*n)->head.rcnt == type - 1)) {
-    artNodeResize(n, 1);
+  if (type != _RADIX && (*n)->head.rcnt == artNodeCap(type)) {
+    artNodeResize(art, n, 1);
     type = (*n)->head.type;
   }
 
@@ -653,7 +912,7 @@ void artNodeAddChild (artNode** n, artNode* c, byte_t b) {
   case _SINGLE:
     p = (artNodeSingle *)*n;
     p->map = b;
-    p->radix = (word_t)c;
+    p->radix = ART_REF(art, c);
     p->head.rcnt = 1;
   break;
   case _INNER:
@@ -664,46 +923,56 @@ void artNodeAddChild (artNode** n, artNode* c, byte_t b) {
       if (!l->radix[i]) break;
     }
     l->map[i] = b;
-    l->radix[i] = (word_t)c;
+    l->radix[i] = ART_REF(art, c);
     l->head.rcnt += 1;
   } break;
-  case _LINEAR16: {
+  case _LINEAR16:
+  case _INNER16: {
     int i;
     l16 = (artNodeLinear16 *)*n;
     for (i = 0; i < _LINEAR16; i++) {
       if (!l16->radix[i]) break;
     }
     l16->map[i] = b;
-    l16->radix[i] = (word_t)c;
+    l16->radix[i] = ART_REF(art, c);
     l16->head.rcnt += 1;
   } break;
   case _SPAN:
+  case _INNER48: {
+    int i;
     s = (artNodeSpan *)*n;
-    if (s->map[b] == _SPAN) {
-      s->map[b] = s->head.rcnt;
-      s->radix[s->head.rcnt] = (word_t)c;
-      s->head.rcnt += 1;
-    } else {
-      s->radix[s->map[b]] = (word_t)c;
-    }
-  break;
+    i = artSpanFind(s, b);
+    if (i >= 0) s->radix[i] = ART_REF(art, c);
+    else artSpanInsert(s, b, ART_REF(art, c));
+  } break;
   case _RADIX:
     r = (artNodeRadix *)*n;
     if (!r->radix[b]) {
       r->head.rcnt += 1;
     }
-    r->radix[b] = (word_t)c;
+    r->radix[b] = ART_REF(art, c);
   break;
   default: break;
   }
 }
 
-void artNodeSetVal (artNode** n, word_t v) {
+/* swaps n between a valued type and its inner type. the layouts agree
+ * up to the value, so the header, heap prefix included, and the child
+ * map move over whole. */
+static void artNodeRetype (Art* art, artNode** n, int type) {
+  artNode* d = artNodeAlloc(art, type);
+  int t = (*n)->head.type;
+  memcpy(d, *n, artNodeSize(artNodeCap(t) == t ? type : t));
+  d->head.type = type;
+  (*n)->head.plen = 0;
+  artNodeFree(art, *n);
+  *n = d;
+}
+
+void artNodeSetVal (Art* art, artNode** n, word_t v) {
   artNodeSingle* p;
   artNodeLinear* l;
   artNodeInner* in;
-  artNodeLinear16* l16;
-  artNodeSpan* s;
   artNodeRadix* r;
   artNodeLeaf* k;
   int i;
@@ -720,7 +989,7 @@ void artNodeSetVal (artNode** n, word_t v) {
     case _INNER:
       if (!v) break;
       in = (artNodeInner *)*n;
-      l = artNodeAlloc(_LINEAR);
+      l = artNodeAlloc(art, _LINEAR);
       for (i = 0; i < _LINEAR; i++) {
         l->map[i] = in->map[i];
         l->radix[i] = in->radix[i];
@@ -729,13 +998,13 @@ void artNodeSetVal (artNode** n, word_t v) {
       artNodeCopyPrefix((artNode *)l, *n);
       l->head.type = _LINEAR;
       l->val = v;
-      artNodeFree(*n);
+      artNodeFree(art, *n);
       *n = (artNode *)l;
     break;
     case _LINEAR:
       l = (artNodeLinear *)*n;
       if (!v) {
-        in = artNodeAlloc(_INNER);
+        in = artNodeAlloc(art, _INNER);
         for (i = 0; i < _LINEAR; i++) {
           in->map[i] = l->map[i];
           in->radix[i] = l->radix[i];
@@ -743,19 +1012,29 @@ void artNodeSetVal (artNode** n, word_t v) {
         in->head.rcnt = l->head.rcnt;
         artNodeCopyPrefix((artNode *)in, *n);
         in->head.type = _INNER;
-        artNodeFree(*n);
+        artNodeFree(art, *n);
         *n = (artNode *)in;
       } else {
         l->val = v;
       }
     break;
     case _LINEAR16:
-      l16 = (artNodeLinear16 *)*n;
-      l16->val = v;
+      if (!v) artNodeRetype(art, n, _INNER16);
+      else ((artNodeLinear16 *)*n)->val = v;
+    break;
+    case _INNER16:
+      if (!v) break;
+      artNodeRetype(art, n, _LINEAR16);
+      ((artNodeLinear16 *)*n)->val = v;
     break;
     case _SPAN:
-      s = (artNodeSpan *)*n;
-      s->val = v;
+      if (!v) artNodeRetype(art, n, _INNER48);
+      else ((artNodeSpan *)*n)->val = v;
+    break;
+    case _INNER48:
+      if (!v) break;
+      artNodeRetype(art, n, _SPAN);
+      ((artNodeSpan *)*n)->val = v;
     break;
     case _RADIX:
       r = (artNodeRadix *)*n;
@@ -765,166 +1044,656 @@ void artNodeSetVal (artNode** n, word_t v) {
   }
 }
 
-void artPut (Art* art, byte_t* k, int l, word_t v) {
+/* rebuilds n as the smallest type for its children and value, with the
+ * child map packed in key order. nodes already in that shape are kept. */
+void artNodeRebuild (Art* art, artNode** n) {
+  byte_t keys[256];
+  artNode* kids[256];
+  artNodeLinear* l;
+  artNodeLinear16* l16;
+  artNode* d;
+  word_t v = artNodeGetVal(*n);
+  int i, type, packed = 1, c = artNodeChildren(art, *n, keys, kids);
+
+  if (c == 0) type = _LEAF;
+  else if (c == 1) type = _SINGLE;
+  else if (c <= _LINEAR) type = v ? _LINEAR : _INNER;
+  else if (c <= _LINEAR16) type = v ? _LINEAR16 : _INNER16;
+  else if (c <= _SPAN) type = v ? _SPAN : _INNER48;
+  else type = _RADIX;
+
+  switch ((*n)->head.type) {
+  case _INNER:
+  case _LINEAR:
+    l = (artNodeLinear *)*n;
+    for (i = 0; i < c && packed; i++)
+      packed = l->radix[i] && l->map[i] == keys[i];
+  break;
+  case _LINEAR16:
+  case _INNER16:
+    l16 = (artNodeLinear16 *)*n;
+    for (i = 0; i < c && packed; i++)
+      packed = l16->radix[i] && l16->map[i] == keys[i];
+  break;
+  default: break;
+  }
+  if (packed && type == (*n)->head.type)
+    return;
+
+  /* the prefix moves over as is, heap copy included */
+  d = artNodeAlloc(art, type);
+  memcpy(d->head.path, (*n)->head.path, sizeof(word_t));
+  d->head.plen = (*n)->head.plen;
+  (*n)->head.plen = 0;
+  for (i = 0; i < c; i++)
+    artNodeAddChild(art, &d, kids[i], keys[i]);
+  if (v) artNodeSetVal(art, &d, v);
+  artNodeFree(art, *n);
+  *n = d;
+}
+
+/* fingers
+ *   a finger keeps the node and key offset of every step of its last
+ *   descent. the next one starts at the deepest of those nodes that was
+ *   reached through a key byte both keys share. every node allocation
+ *   or free moves the tree's version, and a finger from another version
+ *   starts over at the root. */
+
+static void artFingerPush (artFinger* f, artNode* n, int off) {
+  f->stack[f->depth].node = n;
+  f->stack[f->depth++].off = off;
+}
+
+/* the frame to resume from, or 0 for the root. frames past it go. */
+static int artFingerResume (Art* art, artFinger* f, byte_t* k, int l) {
+  int c = 0, m = l < f->len ? l : f->len, j;
+  word_t x = 0;
+  if (f->art != art || f->version != art->version || !f->depth) {
+    f->art = art;
+    f->depth = 0;
+    return 0;
+  }
+  for (; c + ART_WORD <= m; c += ART_WORD) {
+    x = artArrayToWord(k + c) ^ artArrayToWord(f->key + c);
+    if (x) break;
+  }
+  if (c + ART_WORD <= m) c += artWordFirstByte(x);
+  else while (c < m && k[c] == f->key[c]) c++;
+  for (j = f->depth - 1; j > 0 && f->stack[j].off >= c; j--);
+  f->depth = j;
+  return j;
+}
+
+static void artFingerSave (Art* art, artFinger* f, byte_t* k, int l) {
+  memcpy(f->key, k, l);
+  f->len = l;
+  f->version = art->version;
+}
+
+/* returns the value k held before, 0 if it was not in the tree */
+static word_t __artPutFrom (Art* art, artFinger* f, byte_t* k, int l, word_t v) {
   artNode *d, *p, *tmp, *n0, *n1;
-  int rt, i, idx, pfx = 0;
-  byte_t pchar, s0, s1;
+  int rt, i = 0, idx, pfx = 0, j = 0;
+  byte_t pchar = 0, s0, s1;
+  word_t old = 0;
 
   d = p = art->root;
 
-  if (!d || l > 255)
-    return;
+  if (!d || l < 1 || l > 255)
+    return 0;
 
-  for (i = 0; i < l; ) {
+  if (f && (j = artFingerResume(art, f, k, l))) {
+    d = f->stack[j].node;
+    p = f->stack[j - 1].node;
+    i = f->stack[j].off;
+    pchar = k[i];
+  }
+
+  for (; i < l; ) {
+    if (f) artFingerPush(f, d, i);
     pfx = artNodeCheckPrefix(d, k, l, i);
     if (pfx != d->head.plen) {
       rt = (p == art->root);
-      n0 = artNodeAlloc(_SINGLE);
+      /* a split that adds a key gets two children and no value */
+      n0 = artNodeAlloc(art, pfx < l - i ? _INNER : _SINGLE);
       artNodeSetPrefix(n0, artNodeGetPrefix(d), pfx);
       s0 = artNodePrefixIdx(d, pfx);
       artNodeMovePrefix(d, pfx);
-      artNodeAddChild(&n0, d, s0);
-      s1 = k[i + pfx];
+      artNodeAddChild(art, &n0, d, s0);
       if (pfx < l - i) {
-        n1 = artNodeAlloc(_LEAF);
+        s1 = k[i + pfx];
+        n1 = artNodeAlloc(art, _LEAF);
         artNodeSetPrefix(n1, k, l);
         artNodeMovePrefix(n1, i + pfx);
-        artNodeAddChild(&n0, n1, s1);
-        artNodeSetVal(&n1, v);
-      } else artNodeSetVal(&n0, v);
-      artNodeReplaceChild(p, n0, pchar);
+        artNodeAddChild(art, &n0, n1, s1);
+        artNodeSetVal(art, &n1, v);
+      } else artNodeSetVal(art, &n0, v);
+      artNodeReplaceChild(art, p, n0, pchar);
       if (rt) art->root = p;
       break;
     }
     i += pfx;
-    tmp = artNodeGetChild(d, k[i]);
+    if (i == l) {
+      old = artNodeGetVal(d);
+      artNodeSetVal(art, &d, v);
+      artNodeReplaceChild(art, p, d, pchar);
+      break;
+    }
+    tmp = artNodeGetChild(art, d, k[i]);
     if (tmp) {
       pchar = k[i];
       p = d;
       d = tmp;
       continue;
     }
-    if (i == l) {
-      artNodeSetVal(&d, v);
-      artNodeReplaceChild(p, d, pchar);
-      break;
-    }
-    n0 = artNodeAlloc(_LEAF);
-    artNodeSetVal(&n0, v);
+    n0 = artNodeAlloc(art, _LEAF);
+    artNodeSetVal(art, &n0, v);
     artNodeSetPrefix(n0, k + i, l - i);
     tmp = d;
     rt = (d == art->root);
-    artNodeAddChild(&d, n0, k[i]);
+    artNodeAddChild(art, &d, n0, k[i]);
     if (rt) {
       art->root = d;
     } else if (tmp != d) {
-      artNodeReplaceChild(p, d, pchar);
+      artNodeReplaceChild(art, p, d, pchar);
     }
     break;
   }
-  return;
+  if (art->filter) artFilterAdd(art->filter, k, l, !old);
+  /* the last node may have been replaced under its parent */
+  if (f && f->depth) {
+    j = f->stack[--f->depth].off;
+    d = f->depth ? artNodeGetChild(art, f->stack[f->depth - 1].node, pchar)
+                 : art->root;
+    artFingerPush(f, d, j);
+    artFingerSave(art, f, k, l);
+  }
+  return old;
 }
 
-word_t artNodeGetVal (artNode* n) {
-  word_t v;
+word_t __artPut (Art* art, byte_t* k, int l, word_t v) {
+  return __artPutFrom(art, NULL, k, l, v);
+}
+
+static artNode* artGetNodeFrom (Art* art, artFinger* f, byte_t* k, int l) {
+  artFingerFrame* s = f->stack;
+  artNode* d = art->root;
+  int i = 0, j;
+
+  if (!d || l > 255)
+    return NULL;
+  if ((j = artFingerResume(art, f, k, l))) {
+    d = s[j].node;
+    i = s[j].off;
+  }
+  while (d) {
+    s[j].node = d;
+    s[j++].off = i;
+    if (artNodeCheckPrefix(d, k, l, i) != d->head.plen) {
+      d = NULL;
+      break;
+    }
+    i += d->head.plen;
+    if (i == l) break;
+    d = artNodeGetChild(art, d, k[i]);
+  }
+  f->depth = j;
+  artFingerSave(art, f, k, l);
+  return d;
+}
+
+/* the value slot of n, NULL for types that hold no value */
+static word_t* artNodeValSlot (artNode* n) {
   switch (n->head.type) {
     case _LEAF:
-      v = ((artNodeLeaf *)n)->val;
-    break;
+      return &((artNodeLeaf *)n)->val;
     case _SINGLE:
-      v = ((artNodeSingle *)n)->val;
-    break;
+      return &((artNodeSingle *)n)->val;
     case _LINEAR:
-      v = ((artNodeLinear *)n)->val;
-    break;
+      return &((artNodeLinear *)n)->val;
     case _LINEAR16:
-      v = ((artNodeLinear16 *)n)->val;
-    break;
+      return &((artNodeLinear16 *)n)->val;
     case _SPAN:
-      v = ((artNodeSpan *)n)->val;
-    break;
+      return &((artNodeSpan *)n)->val;
     case _RADIX:
-      v = ((artNodeRadix *)n)->val;
-    break;
-    default:  
-      v = 0;
-    break;
+      return &((artNodeRadix *)n)->val;
+    default:
+      return NULL;
   }
-  return v;
-}
-
-word_t artGet (Art* art, byte_t* k, int l) {
-  artNode *d;
-  word_t v;
-
-  d = artGetNode(art, k, l, 0);
-  v = artNodeGetVal(d);
-  return v;
 }
 
-Art* artNew (void) {
-  Art* d = artMalloc(sizeof(Art));
-  d->root = artNodeAlloc(_SINGLE);
-  return d;
+word_t artNodeGetVal (artNode* n) {
+  word_t* v = artNodeValSlot(n);
+  return v ? *v : 0;
 }
 
-int artRemove (Art* art, byte_t* k, int l) {
-  artNode *d, *m, *p, *tmp;
-  int i = 0, idx = 0, sptr = 0, pfx = 0;
-  word_t* stack = artMalloc(sizeof(word_t) * (l + 1));
-  byte_t* schars = artMalloc(l + 1), c;
+/* transcoders
+ *   a codec maps keys to shorter byte strings in the same order. the
+ *   public calls encode on the way in and scans decode on the way out.
+ *   a scan prefix encodes to the bytes every matching key starts with,
+ *   and the decoded keys are checked against the raw prefix. */
 
-  d = art->root;
+typedef struct {
+  Art*       art;
+  byte_t*    p;
+  int        l;
+  artVisitor fn;
+  void*      ctx;
+} artDecodeCtx;
 
-  if (!d || l > 255)
-    return 0;
+static const char artHexChars[] = "0123456789abcdef";
 
-  for (i = 0; i < l; ) {
-    pfx = artNodeCheckPrefix(d, k, l, i);
-    if (pfx != d->head.plen) return 0;
-    i += pfx;
-    stack[sptr] = (word_t)d;
-    schars[sptr] = k[i];
-    tmp = artNodeGetChild(d, k[i]);
-    if (tmp && i < l) {
-      d = tmp;
-      sptr++;
+/* complete pairs of lowercase hex digits, skipping dashes where a
+ * uuid has them when uuid is set. digits are checked and converted
+ * without branches since random hex defeats prediction. */
+static int artHexPack (byte_t* in, int l, byte_t* out, int uuid) {
+  int i, n = 0, bad = 0;
+  byte_t c, d, half = 0;
+  for (i = 0; i < l; i++) {
+    c = in[i];
+    if (uuid && (i == 8 || i == 13 || i == 18 || i == 23)) {
+      bad |= c != '-';
       continue;
     }
-    break;
+    bad |= ((unsigned)(c - '0') > 9) & ((unsigned)(c - 'a') > 5);
+    d = (byte_t)((c & 15) + 9 * (c >> 6));
+    if (n & 1) out[n >> 1] = (byte_t)(half << 4 | d);
+    half = d;
+    n++;
   }
+  return bad ? -1 : n >> 1;
+}
 
-  if (!artNodeGetVal(d)) 
-    return 0;
+static int artUUIDEncode (byte_t* in, int l, byte_t* out) {
+  return l == 36 ? artHexPack(in, l, out, 1) : -1;
+}
 
-  /* custom destroy node value function */
+static int artUUIDDecode (byte_t* in, int l, byte_t* out) {
+  int i, n = 0;
+  if (l != 16) return -1;
+  for (i = 0; i < 16; i++) {
+    if (i == 4 || i == 6 || i == 8 || i == 10) out[n++] = '-';
+    out[n++] = artHexChars[in[i] >> 4];
+    out[n++] = artHexChars[in[i] & 15];
+  }
+  return n;
+}
 
-  tmp = d;
-  artNodeSetVal(&d, (word_t)NULL);
+static int artUUIDPrefix (byte_t* in, int l, byte_t* out) {
+  return l <= 36 ? artHexPack(in, l, out, 1) : -1;
+}
 
-  if (tmp != d) {
-    stack[sptr] = (word_t)d;
-    artNodeReplaceChild((artNode *)stack[sptr-1], d, schars[sptr - 1]);
+static int artHexEncode (byte_t* in, int l, byte_t* out) {
+  return l & 1 ? -1 : artHexPack(in, l, out, 0);
+}
+
+static int artHexDecode (byte_t* in, int l, byte_t* out) {
+  int i;
+  for (i = 0; i < l; i++) {
+    out[2 * i] = artHexChars[in[i] >> 4];
+    out[2 * i + 1] = artHexChars[in[i] & 15];
   }
+  return 2 * l;
+}
 
-  if (d->head.type != _LEAF) {
-    return 1;
+static int artHexPrefix (byte_t* in, int l, byte_t* out) {
+  return artHexPack(in, l, out, 0);
+}
+
+/* a-z as 1-26 in 5 bits. the zero padding sorts a key before any of its
+ * extensions, and a zero symbol ends decoding. */
+static int artAlphaPack (byte_t* in, int l, byte_t* out, int whole) {
+  word_t acc = 0;
+  int i, bits = 0, n = 0;
+  for (i = 0; i < l; i++) {
+    if (in[i] < 'a' || in[i] > 'z') return -1;
+    acc = acc << 5 | (word_t)(in[i] - 'a' + 1);
+    for (bits += 5; bits >= 8; bits -= 8)
+      out[n++] = (byte_t)(acc >> (bits - 8));
   }
+  if (whole && bits) out[n++] = (byte_t)(acc << (8 - bits));
+  return n;
+}
 
-  stack[sptr] = (word_t)d;
+static int artAlphaEncode (byte_t* in, int l, byte_t* out) {
+  return artAlphaPack(in, l, out, 1);
+}
 
-  for (i = sptr; i > 0; i--) {
+static int artAlphaDecode (byte_t* in, int l, byte_t* out) {
+  word_t acc = 0;
+  int i, bits = 0, n = 0;
+  for (i = 0; i < l; i++) {
+    acc = acc << 8 | in[i];
+    for (bits += 8; bits >= 5; bits -= 5) {
+      if (!((acc >> (bits - 5)) & 31)) return n;
+      out[n++] = (byte_t)('a' - 1 + ((acc >> (bits - 5)) & 31));
+    }
+  }
+  return n;
+}
+
+static int artAlphaPrefix (byte_t* in, int l, byte_t* out) {
+  return artAlphaPack(in, l, out, 0);
+}
+
+/* canonical decimal numbers as a length byte and the big-endian value,
+ * so keys sort numerically. numeric order does not keep a decimal
+ * prefix together, so scans filter the whole tree. */
+static int artDecimalEncode (byte_t* in, int l, byte_t* out) {
+  word_t v = 0;
+  int i, n;
+  if (l < 1 || l > 19 || (in[0] == '0' && l > 1)) return -1;
+  for (i = 0; i < l; i++) {
+    if (in[i] < '0' || in[i] > '9') return -1;
+    v = v * 10 + (in[i] - '0');
+  }
+  for (n = 0; n < 8 && v >> (8 * n); n++);
+  out[0] = (byte_t)n;
+  for (i = 0; i < n; i++)
+    out[1 + i] = (byte_t)(v >> (8 * (n - 1 - i)));
+  return n + 1;
+}
+
+static int artDecimalDecode (byte_t* in, int l, byte_t* out) {
+  byte_t digits[20];
+  word_t v = 0;
+  int i, n = 0;
+  for (i = 1; i < l; i++) v = v << 8 | in[i];
+  do {
+    digits[n++] = (byte_t)('0' + v % 10);
+    v /= 10;
+  } while (v);
+  for (i = 0; i < n; i++) out[i] = digits[n - 1 - i];
+  return n;
+}
+
+static int artDecimalPrefix (byte_t* in, int l, byte_t* out) {
+  return 0;
+}
+
+artCodec artCodecUUID    = { artUUIDEncode, artUUIDDecode, artUUIDPrefix };
+artCodec artCodecHex     = { artHexEncode, artHexDecode, artHexPrefix };
+artCodec artCodecAlpha   = { artAlphaEncode, artAlphaDecode, artAlphaPrefix };
+artCodec artCodecDecimal = { artDecimalEncode, artDecimalDecode, artDecimalPrefix };
+
+void artSetCodec (Art* art, artCodec* codec) {
+  art->codec = codec;
+}
+
+/* keys the codec cannot represent, or of the wrong length for a fixed
+ * tree, are never in the tree */
+static int artEncode (Art* art, byte_t** k, int* l, byte_t* buf) {
+  if (art->codec) {
+    if (*l > 255) return 0;
+    *l = art->codec->encode(*k, *l, buf);
+    *k = buf;
+    if (*l < 0) return 0;
+  }
+  return !(art->flags & ART_FIXED) || *l == art->klen;
+}
+
+/* the first n bytes of a word in memory order, n from 1 to ART_WORD */
+static word_t artWordMask (int n) {
+  if (n == ART_WORD) return ~(word_t)0;
+  if (artLittleEndian()) return ((word_t)1 << 8 * n) - 1;
+  return ~(~(word_t)0 >> 8 * n);
+}
+
+/* every fixed key ends in a leaf, and the prefixes on the way can't run
+ * past the key, so there is no end of key test and no clamp on the
+ * compare. a prefix held in the node is one masked word compare while
+ * a word of key is left. */
+static artNode* artGetFixed (Art* art, byte_t* k) {
+  artNode* d = art->root;
+  int i = 0, m, l = art->klen;
+  for (;;) {
+    if ((m = d->head.plen)) {
+      if (m <= ART_WORD && i + ART_WORD <= l) {
+        if ((artArrayToWord(d->head.path) ^ artArrayToWord(k + i)) & artWordMask(m))
+          return NULL;
+      } else if (artNodeCheckPrefix(d, k, l, i) != m)
+        return NULL;
+      i += m;
+    }
+    if (d->head.type == _LEAF)
+      return d;
+    if (!(d = artNodeGetChild(art, d, k[i])))
+      return NULL;
+  }
+}
+
+static int artDecodeVisitor (void* ctx, byte_t* k, int l, word_t v) {
+  artDecodeCtx* c = ctx;
+  byte_t raw[512];
+  l = c->art->codec->decode(k, l, raw);
+  if (l < c->l || memcmp(raw, c->p, c->l))
+    return 0;
+  return c->fn(c->ctx, raw, l, v);
+}
+
+/* the public calls encode the key, check the write buffer, and then go
+ * to the tree through the calls below */
+
+static word_t artGetEncoded (Art* art, artFinger* f, byte_t* k, int l) {
+  artNode* d;
+  if (art->filter && !artFilterHas(art->filter, k, l))
+    return 0;
+  if (f)
+    d = artGetNodeFrom(art, f, k, l);
+  else if (art->flags & ART_FIXED)
+    d = artGetFixed(art, k);
+  else
+    d = artGetNode(art, k, l, NULL);
+  if (!d) return 0;
+  if (art->cache) ART_USED(art, d) = 1;
+  return artNodeGetVal(d);
+}
+
+word_t artGet (Art* art, byte_t* k, int l) {
+  word_t* e;
+  byte_t buf[256];
+
+  if (!artEncode(art, &k, &l, buf))
+    return 0;
+  if (art->buffer && (e = artBufferFind(art->buffer, k, l)))
+    return *e;
+  return artGetEncoded(art, NULL, k, l);
+}
+
+word_t artGetFinger (Art* art, artFinger* f, byte_t* k, int l) {
+  word_t* e;
+  byte_t buf[256];
+
+  if (!artEncode(art, &k, &l, buf))
+    return 0;
+  if (art->buffer && (e = artBufferFind(art->buffer, k, l)))
+    return *e;
+  return artGetEncoded(art, f, k, l);
+}
+
+void artPut (Art* art, byte_t* k, int l, word_t v) {
+  byte_t buf[256];
+  if (!art->buffer) {
+    artExchange(art, k, l, v);
+    return;
+  }
+  if (artEncode(art, &k, &l, buf))
+    artBufferPut(art, k, l, v, 0);
+}
+
+static word_t artExchangeEncoded (Art* art, artFinger* f, byte_t* k, int l, word_t v) {
+  word_t old = __artPutFrom(art, f, k, l, v);
+  if (art->flags & ART_SCORED)
+    artScorePath(art, k, l);
+  if (art->flags & ART_MERKLE)
+    artMerklePath(art, k, l, old, v);
+  if (art->feed) artFeedAppend(art->feed, ART_FEED_PUT, k, l, v);
+  if (art->cache) artCacheEvict(art, k, l);
+  return old;
+}
+
+word_t artExchange (Art* art, byte_t* k, int l, word_t v) {
+  word_t* e;
+  byte_t buf[256];
+  word_t old;
+  if (art->flags & ART_MULTI) {
+    artAdd(art, k, l, v);
+    return 0;
+  }
+  if (!artEncode(art, &k, &l, buf))
+    return 0;
+  if (!art->buffer)
+    return artExchangeEncoded(art, NULL, k, l, v);
+  e = artBufferFind(art->buffer, k, l);
+  old = e ? *e : artGetEncoded(art, NULL, k, l);
+  artBufferPut(art, k, l, v, 0);
+  return old;
+}
+
+void artPutFinger (Art* art, artFinger* f, byte_t* k, int l, word_t v) {
+  byte_t buf[256];
+  if (art->buffer || (art->flags & ART_MULTI)) {
+    artPut(art, k, l, v);
+    return;
+  }
+  if (artEncode(art, &k, &l, buf))
+    artExchangeEncoded(art, f, k, l, v);
+}
+
+static int artRemoveEncoded (Art* art, byte_t* k, int l) {
+  artNode* d;
+  word_t v = 0;
+  if (art->filter && !artFilterHas(art->filter, k, l))
+    return 0;
+  if (art->flags & (ART_MULTI | ART_MERKLE)) {
+    d = artGetNode(art, k, l, NULL);
+    if (d) v = artNodeGetVal(d);
+  }
+  if (!__artRemove(art, k, l, 0))
+    return 0;
+  if (art->filter) art->filter->removed++;
+  if (art->feed) artFeedAppend(art->feed, ART_FEED_REMOVE, k, l, 0);
+  if (v && (art->flags & ART_MULTI)) free((void *)v);
+  if (art->flags & ART_SCORED)
+    artScorePath(art, k, l);
+  if (art->flags & ART_MERKLE)
+    artMerklePath(art, k, l, v, 0);
+  return 1;
+}
+
+int artRemove (Art* art, byte_t* k, int l) {
+  word_t* e;
+  byte_t buf[256];
+  if (!artEncode(art, &k, &l, buf))
+    return 0;
+  if (!art->buffer)
+    return artRemoveEncoded(art, k, l);
+  e = artBufferFind(art->buffer, k, l);
+  if (e ? !*e : !artGetEncoded(art, NULL, k, l))
+    return 0;
+  artBufferPut(art, k, l, 0, 1);
+  return 1;
+}
+
+Art* artNewMulti (void) {
+  Art* d = artNew();
+  d->flags |= ART_MULTI;
+  return d;
+}
+
+/* the root was counted by artNew, and goes back out of the count */
+Art* artNewPrivate (void) {
+  Art* d = artNew();
+  bytes -= d->bytes;
+  d->flags |= ART_PRIVATE;
+  return d;
+}
+
+Art* artNewFixed (int len) {
+  Art* d = artNew();
+  d->flags |= ART_FIXED;
+  d->klen = len;
+  return d;
+}
+
+/* ext must be known before the root is allocated in front of it */
+static Art* artNewWith (int flags, int ext) {
+  Art* d = artMalloc(sizeof(Art));
+  d->flags = flags;
+  d->ext = ext;
+#ifdef ART_COMPACT
+  d->arena = artArenaNew(NULL);
+#endif
+  d->root = artNodeAlloc(d, _SINGLE);
+  return d;
+}
+
+Art* artNew (void) {
+  return artNewWith(0, 0);
+}
+
+/* with dead set, k must still be in the tree with its value cleared by
+ * artRemoveLazy, and only the structural work is done */
+int __artRemove (Art* art, byte_t* k, int l, int dead) {
+  artNode *d, *m, *p, *tmp;
+  int i = 0, idx = 0, sptr = 0, pfx = 0;
+  word_t stack[256];
+  byte_t schars[256], c;
+
+  d = art->root;
+
+  if (!d || l > 255)
+    return 0;
+
+  for (i = 0; i < l; ) {
+    pfx = artNodeCheckPrefix(d, k, l, i);
+    if (pfx != d->head.plen) return 0;
+    i += pfx;
+    stack[sptr] = (word_t)d;
+    if (i == l) break;
+    schars[sptr] = k[i];
+    tmp = artNodeGetChild(art, d, k[i]);
+    if (!tmp) return 0;
+    d = tmp;
+    sptr++;
+  }
+
+  if (dead ? artNodeGetVal(d) != 0 : !artNodeGetVal(d))
+    return 0;
+
+  /* custom destroy node value function */
+
+  tmp = d;
+  artNodeSetVal(art, &d, (word_t)NULL);
+
+  if (tmp != d) {
+    stack[sptr] = (word_t)d;
+    artNodeReplaceChild(art, (artNode *)stack[sptr-1], d, schars[sptr - 1]);
+  }
+
+  if (d->head.type != _LEAF) {
+    /* a valueless node left with one child folds into it */
+    if (sptr && d->head.rcnt == 1) {
+      artNodeMergeWithChild(art, &d);
+      artNodeReplaceChild(art, (artNode *)stack[sptr - 1], d, schars[sptr - 1]);
+    }
+    return 1;
+  }
+
+  stack[sptr] = (word_t)d;
+
+  for (i = sptr; i > 0; i--) {
     d = (artNode *)stack[i];
     p = (artNode *)stack[i - 1];
     c = schars[i - 1];
-    artNodeReplaceChild(p, d, c);
+    artNodeReplaceChild(art, p, d, c);
     if (!d->head.rcnt && !artNodeGetVal(d)) {
-      artNodeFree(d);
-      artNodeRemoveChild(&p, c);
+      artNodeFree(art, d);
+      artNodeRemoveChild(art, &p, c);
       stack[i] = 0;
     } else if (d->head.rcnt == 1 && !artNodeGetVal(d)) {
-      artNodeMergeWithChild(&d);
-      artNodeReplaceChild(p, d, c);
+      artNodeMergeWithChild(art, &d);
+      artNodeReplaceChild(art, p, d, c);
       stack[i] = (word_t)d;
     } else {
       break;
@@ -936,10 +1705,11 @@ int artRemove (Art* art, byte_t* k, int l) {
   return 1;
 }
 
-artNode* artGetNode (Art* art, byte_t* k, int l, int p) {
-  artNode *d, *tmp;
+/* exact lookup when e is NULL. otherwise k is a prefix: the node whose
+ * path covers it is returned and e receives the depth the node starts at. */
+artNode* artGetNode (Art* art, byte_t* k, int l, int* e) {
+  artNode *d;
   int i, pfx = 0;
-  word_t v;
 
   d = art->root;
 
@@ -949,107 +1719,2533 @@ artNode* artGetNode (Art* art, byte_t* k, int l, int p) {
   for (i = 0; i < l; ) {
     pfx = artNodeCheckPrefix(d, k, l, i);
     if (pfx != d->head.plen) {
-      if (!p || !pfx || pfx != l) return NULL;
-      else return d;
+      if (!e || i + pfx != l) return NULL;
+      *e = i;
+      return d;
     }
+    if (i + pfx == l) break;
     i += pfx;
-    tmp = artNodeGetChild(d, k[i]);
-    if (tmp && i < l) {
-      d = tmp;
-      continue;
-    }
-    if (p) {
-      if (i == l) return d;
-      else return NULL;
+    d = artNodeGetChild(art, d, k[i]);
+    if (!d) return NULL;
+  }
+  if (e) *e = i;
+  return d;
+}
+
+/* value of the longest stored key that is a prefix of k. every node
+ * whose path is fully consumed is a candidate, so the last one holding a
+ * value on the way down wins. */
+word_t artLongestPrefix (Art* art, byte_t* k, int l, int* m) {
+  artNode *d;
+  word_t v, best = 0;
+  int i = 0;
+
+  artFlush(art);
+  d = art->root;
+  if (m) *m = 0;
+  while (d) {
+    if (artNodeCheckPrefix(d, k, l, i) != d->head.plen)
+      break;
+    i += d->head.plen;
+    v = artNodeGetVal(d);
+    if (v) {
+      best = v;
+      if (m) *m = i;
     }
-    break;
+    if (i >= l) break;
+    d = artNodeGetChild(art, d, k[i]);
+  }
+  return best;
+}
+
+void artScan (Art* art, byte_t* p, int l, artVisitor fn, void* ctx) {
+  byte_t key[256], enc[256];
+  artDecodeCtx c;
+  artNode* d;
+  int e;
+  artFlush(art);
+  if (art->codec) {
+    c.art = art;
+    c.p = p;
+    c.l = l;
+    c.fn = fn;
+    c.ctx = ctx;
+    if (l > 255 || (l = art->codec->prefix(p, l, enc)) < 0)
+      return;
+    p = enc;
+    fn = artDecodeVisitor;
+    ctx = &c;
+  }
+  d = artGetNode(art, p, l, &e);
+  if (!d) return;
+  memcpy(key, p, e);
+  __artWalk(art, d, 0, key, e, fn, ctx);
+}
+
+/* collects scan results into an artVal list, keeping its tail */
+int artCollectVisitor (void* ctx, byte_t* k, int l, word_t v) {
+  artVal** tail = (artVal **)ctx;
+  artVal* n = artMalloc(sizeof(artVal));
+  n->key = artMalloc(l + 1);
+  memcpy(n->key, k, l);
+  n->val = v;
+  (*tail)->next = n;
+  *tail = n;
+  return 0;
+}
+
+artVal* artGetWithPrefix (Art* art, byte_t* p, int l) {
+  artVal head, *tail = &head;
+  head.next = NULL;
+  artScan(art, p, l, artCollectVisitor, &tail);
+  return (artVal *)head.next;
+}
+
+/* multi-value
+ *   in ART_MULTI trees the value slot of a key points to an artPosting:
+ *   its values kept sorted and unique in one growable block, so a lookup
+ *   or an intersection of two keys walks contiguous memory. */
+
+artPosting* artPostingResize (artPosting* p, int cap) {
+  size_t s = sizeof(artPosting) + (cap - 1) * sizeof(word_t);
+  p = realloc(p, s);
+  if (!p) {
+    fprintf(stderr, "Fatal: out of memory.");
+    abort();
+  }
+  p->cap = cap;
+  return p;
+}
+
+/* index of the first value >= v */
+static int artPostingFind (artPosting* p, word_t v) {
+  int lo = 0, hi = p->cnt, mid;
+  while (lo < hi) {
+    mid = (lo + hi) >> 1;
+    if (p->vals[mid] < v) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+int artAdd (Art* art, byte_t* k, int l, word_t v) {
+  artNode* d;
+  artPosting *p, *np;
+  byte_t buf[256];
+  int i;
+
+  if (!artEncode(art, &k, &l, buf))
+    return 0;
+  d = artGetNode(art, k, l, NULL);
+  p = d ? (artPosting *)artNodeGetVal(d) : NULL;
+
+  if (!p) {
+    p = artPostingResize(NULL, 4);
+    p->cnt = 1;
+    p->vals[0] = v;
+    __artPut(art, k, l, (word_t)p);
+    return 1;
+  }
+
+  i = artPostingFind(p, v);
+  if (i < p->cnt && p->vals[i] == v)
+    return 0;
+
+  np = p;
+  if (p->cnt == p->cap)
+    np = artPostingResize(p, p->cap * 2);
+  memmove(np->vals + i + 1, np->vals + i, (np->cnt - i) * sizeof(word_t));
+  np->vals[i] = v;
+  np->cnt += 1;
+  if (np != p) artNodeSetVal(art, &d, (word_t)np);
+  return 1;
+}
+
+int artRemoveValue (Art* art, byte_t* k, int l, word_t v) {
+  artNode* d;
+  artPosting *p, *np;
+  byte_t buf[256];
+  int i;
+
+  if (!artEncode(art, &k, &l, buf))
+    return 0;
+  d = artGetNode(art, k, l, NULL);
+  p = d ? (artPosting *)artNodeGetVal(d) : NULL;
+  if (!p) return 0;
+
+  i = artPostingFind(p, v);
+  if (i == p->cnt || p->vals[i] != v)
+    return 0;
+
+  if (p->cnt == 1)
+    return artRemoveEncoded(art, k, l);
+
+  p->cnt -= 1;
+  memmove(p->vals + i, p->vals + i + 1, (p->cnt - i) * sizeof(word_t));
+  if (p->cap > 4 && p->cnt <= p->cap / 4) {
+    np = artPostingResize(p, p->cap / 2);
+    if (np != p) artNodeSetVal(art, &d, (word_t)np);
+  }
+  return 1;
+}
+
+word_t* artGetValues (Art* art, byte_t* k, int l, int* n) {
+  artPosting* p = (artPosting *)artGet(art, k, l);
+  *n = p ? p->cnt : 0;
+  return p ? p->vals : NULL;
+}
+
+/* scored
+ *   ART_SCORED trees keep the best score below each node in the word in
+ *   front of it. nodes are rescored bottom-up along the path of every
+ *   put and remove. reallocated nodes start at zero, so the whole path
+ *   is redone rather than stopping at the first unchanged node. */
+
+#define ART_SCORE(a, n) (*(word_t *)((byte_t *)(n) - (a)->ext))
+
+typedef struct {
+  word_t score;
+  int    rec;
+  int    val;
+} artRank;
+
+typedef struct {
+  artNode* n;
+  int      parent;
+} artRankNode;
+
+static word_t artValScore (Art* art, word_t v) {
+  return art->score ? art->score(v) : v;
+}
+
+void artNodeRescore (Art* art, artNode* n) {
+  byte_t keys[256];
+  artNode* kids[256];
+  word_t v = artNodeGetVal(n), m = v ? artValScore(art, v) : 0;
+  int i, c = artNodeChildren(art, n, keys, kids);
+  for (i = 0; i < c; i++) {
+    if (ART_SCORE(art, kids[i]) > m)
+      m = ART_SCORE(art, kids[i]);
+  }
+  ART_SCORE(art, n) = m;
+}
+
+/* every node reached along k's edges, including a node whose prefix
+ * stops matching, which a removal may have merged into place */
+void artScorePath (Art* art, byte_t* k, int l) {
+  artNode* path[257];
+  artNode* n = art->root;
+  int d = 0, i = 0, pfx;
+  while (n) {
+    path[d++] = n;
+    pfx = artNodeCheckPrefix(n, k, l, i);
+    if (pfx != n->head.plen) break;
+    i += pfx;
+    if (i >= l) break;
+    n = artNodeGetChild(art, n, k[i]);
   }
+  while (d--)
+    artNodeRescore(art, path[d]);
+}
+
+Art* artNewScored (artScoreFn fn) {
+  Art* d = artNewWith(ART_SCORED, sizeof(word_t));
+  d->score = fn;
   return d;
 }
 
-void __artGetWithPrefix (artNode* n, artVal* v, byte_t* pref, int plen) {
-  artNodeSingle* p;
-  artNodeLinear* l;
-  artNodeLinear16* l16;
-  artNodeSpan* s;
-  artNodeRadix* r;
-  artVal* iter;
-  int ln, i, nplen;
-  byte_t type;
-  word_t val;
-  byte_t* npref;
-
-  if (!n) return;
-  if (n->head.plen || plen) {
-    npref = malloc(n->head.plen + plen);
-    memcpy(npref, pref, plen);
-    memcpy(npref + plen, artNodeGetPrefix(n), n->head.plen);
-  }
-  nplen = n->head.plen + plen;
-  val = artNodeGetVal(n);
-  if (val) {
-    iter = v;
-    while (iter->next)
-      iter = (artVal *)iter->next;
-    iter->next = artMalloc(sizeof(artVal));
-    iter = (artVal *)iter->next;
-    iter->next = NULL;
-    iter->val = val;
-    iter->key = npref;
+static void artRankPush (artRank** heap, int* n, int* cap, word_t score, int rec, int val) {
+  artRank* h;
+  artRank t;
+  int i;
+  if (*n == *cap) {
+    *cap = *cap ? *cap * 2 : 64;
+    *heap = realloc(*heap, *cap * sizeof(artRank));
+    if (!*heap) {
+      fprintf(stderr, "Fatal: out of memory.");
+      abort();
+    }
+  }
+  h = *heap;
+  i = (*n)++;
+  h[i].score = score;
+  h[i].rec = rec;
+  h[i].val = val;
+  for (; i > 0 && h[(i - 1) / 2].score < h[i].score; i = (i - 1) / 2) {
+    t = h[i];
+    h[i] = h[(i - 1) / 2];
+    h[(i - 1) / 2] = t;
   }
+}
 
-  ln = n->head.plen;
-  type = n->head.type;
+static artRank artRankPop (artRank* h, int* n) {
+  artRank top = h[0], t;
+  int i = 0, j;
+  h[0] = h[--(*n)];
+  for (;;) {
+    j = 2 * i + 1;
+    if (j >= *n) break;
+    if (j + 1 < *n && h[j + 1].score > h[j].score) j++;
+    if (h[i].score >= h[j].score) break;
+    t = h[i];
+    h[i] = h[j];
+    h[j] = t;
+    i = j;
+  }
+  return top;
+}
 
-  switch (type) {
-  case _SINGLE:
-    p = (artNodeSingle *)n;
-    __artGetWithPrefix((artNode *)p->radix, v, npref, nplen);
-  break;
-  case _INNER:
-  case _LINEAR:
-    l = (artNodeLinear *)n;
-    for (i = 0; i < _LINEAR; i++)
-      __artGetWithPrefix((artNode *)l->radix[i], v, npref, nplen);
-  break;
-  case _LINEAR16:
-    l16 = (artNodeLinear16 *)n;
-    for (i = 0; i < _LINEAR16; i++)
-      __artGetWithPrefix((artNode *)l16->radix[i], v, npref, nplen);
-  break;
-  case _SPAN:
-    s = (artNodeSpan *)n;
-    for (i = 0; i < _SPAN; i++)
-      __artGetWithPrefix((artNode *)s->radix[i], v, npref, nplen);
-  break;
-  case _RADIX:
-    r = (artNodeRadix *)n;
-    for (i = 0; i < 256; i++)
-      __artGetWithPrefix((artNode *)r->radix[i], v, npref, nplen);
-  break;
-  default: return;
+/* best first: a node enters the queue with its cached subtree score and,
+ * once taken, queues its own value and its children. values come out in
+ * score order, so only the nodes on the way to the k best are expanded. */
+int artTopK (Art* art, byte_t* p, int l, int k, artVal* out) {
+  byte_t keys[256];
+  artNode* kids[256];
+  artNode* chain[256];
+  artRank* heap = NULL;
+  artRankNode* recs;
+  artRank top;
+  artNode* n;
+  word_t v;
+  byte_t* key;
+  int e, i, c, r, len, found = 0, hn = 0, hcap = 0, nrecs = 0, rcap = 64;
+
+  if (!(art->flags & ART_SCORED) || k < 1)
+    return 0;
+  artFlush(art);
+  n = artGetNode(art, p, l, &e);
+  if (!n) return 0;
+
+  recs = artMalloc(rcap * sizeof(artRankNode));
+  recs[nrecs].n = n;
+  recs[nrecs++].parent = -1;
+  artRankPush(&heap, &hn, &hcap, ART_SCORE(art, n), 0, 0);
+
+  while (found < k && hn) {
+    top = artRankPop(heap, &hn);
+    n = recs[top.rec].n;
+    if (top.val) {
+      for (c = 0, r = top.rec; r >= 0; r = recs[r].parent)
+        chain[c++] = recs[r].n;
+      for (len = e, i = 0; i < c; i++)
+        len += chain[i]->head.plen;
+      key = artMalloc(len + 1);
+      memcpy(key, p, e);
+      for (len = e; c--; len += chain[c]->head.plen)
+        memcpy(key + len, artNodeGetPrefix(chain[c]), chain[c]->head.plen);
+      out[found].key = key;
+      out[found].val = artNodeGetVal(n);
+      out[found++].next = NULL;
+      continue;
+    }
+    v = artNodeGetVal(n);
+    if (v) artRankPush(&heap, &hn, &hcap, artValScore(art, v), top.rec, 1);
+    c = artNodeChildren(art, n, keys, kids);
+    for (i = 0; i < c; i++) {
+      if (nrecs == rcap) {
+        rcap *= 2;
+        recs = realloc(recs, rcap * sizeof(artRankNode));
+        if (!recs) {
+          fprintf(stderr, "Fatal: out of memory.");
+          abort();
+        }
+      }
+      recs[nrecs].n = kids[i];
+      recs[nrecs].parent = top.rec;
+      artRankPush(&heap, &hn, &hcap, ART_SCORE(art, kids[i]), nrecs++, 0);
+    }
   }
-  return;
+  free(heap);
+  free(recs);
+  return found;
 }
 
-artVal* artGetWithPrefix (Art* art, byte_t* p, int l) {
+/* deferred removal
+ *   a lazily removed key keeps its node with a zero value, which every
+ *   lookup and walk already treats as absent. a put on the key before
+ *   maintenance simply revives the node. */
+
+#define ART_QUEUE_BLOCK 4096
+
+/* keys are stored as a length byte and the key bytes */
+typedef struct artQueueBlock {
+  struct artQueueBlock* next;
+  int                   len;
+  byte_t                data[ART_QUEUE_BLOCK];
+} artQueueBlock;
+
+int artRemoveLazy (Art* art, byte_t* k, int l) {
+  artQueue* q;
+  artQueueBlock* b;
   artNode* d;
-  artVal* v, *del;
-  v = artMalloc(sizeof(artVal));
-  v->val = (word_t)0;
-  v->next = NULL;
-  d = artGetNode(art, p, l, 1);
-  __artGetWithPrefix(d, v, p, l - d->head.plen);
-  if (v->next) {
-    del = v;
-    v = v->next;
-    free(del);
-  } else {
-    free(v);
-    v = NULL;
+  word_t v;
+  byte_t buf[256];
+
+  if (art->buffer)
+    return artRemove(art, k, l);
+  if (!artEncode(art, &k, &l, buf) || l < 1)
+    return 0;
+  d = artGetNode(art, k, l, NULL);
+  if (!d || !(v = artNodeGetVal(d)))
+    return 0;
+  *artNodeValSlot(d) = 0;
+  if (art->flags & ART_MULTI) free((void *)v);
+  if (art->flags & ART_MERKLE) artMerklePath(art, k, l, v, 0);
+  if (art->filter) art->filter->removed++;
+  if (art->feed) artFeedAppend(art->feed, ART_FEED_REMOVE, k, l, 0);
+
+  if (!art->lazy) art->lazy = artMalloc(sizeof(artQueue));
+  q = art->lazy;
+  b = q->tail;
+  if (!b || b->len + l + 1 > ART_QUEUE_BLOCK) {
+    b = malloc(sizeof(artQueueBlock));
+    if (!b) {
+      fprintf(stderr, "Fatal: out of memory.");
+      abort();
+    }
+    b->next = NULL;
+    b->len = 0;
+    if (q->tail) ((artQueueBlock *)q->tail)->next = b;
+    else q->head = b;
+    q->tail = b;
   }
-  return v;
+  b->data[b->len] = (byte_t)l;
+  memcpy(b->data + b->len + 1, k, l);
+  b->len += l + 1;
+  q->cnt++;
+  return 1;
+}
+
+int artMaintenance (Art* art, int budget) {
+  artQueue* q = art->lazy;
+  artQueueBlock* b;
+  byte_t* k;
+
+  artFlush(art);
+  if (!q) return 0;
+  for (; budget > 0 && q->cnt; budget--) {
+    b = q->head;
+    if (q->pos == b->len) {
+      q->head = b->next;
+      q->pos = 0;
+      free(b);
+      b = q->head;
+    }
+    k = b->data + q->pos;
+    if (__artRemove(art, k + 1, k[0], 1)) {
+      if (art->flags & ART_SCORED)
+        artScorePath(art, k + 1, k[0]);
+      if (art->flags & ART_MERKLE)
+        artMerklePath(art, k + 1, k[0], 0, 0);
+    }
+    q->pos += k[0] + 1;
+    q->cnt--;
+  }
+  if (!q->cnt && q->head) {
+    /* keep the last block for the next round of removals */
+    b = q->head;
+    while (b->next) {
+      q->head = b->next;
+      free(b);
+      b = q->head;
+    }
+    b->len = q->pos = 0;
+  }
+  return q->cnt;
+}
+
+/* write buffer
+ *   a hashed delta of encoded keys in front of the tree. puts and
+ *   removes land in it, and lookups check it first. when it fills, the
+ *   entries are sorted and applied in key order, so consecutive writes
+ *   walk mostly the same nodes while they are still in cache. every
+ *   other reader flushes it first. */
+
+/* head holds the leading key bytes big endian, so entries sort by it
+ * before their keys are compared */
+typedef struct {
+  word_t  val;
+  word_t  hash;
+  word_t  head;
+  int     off;
+  int     dead;
+} artBufferEntry;
+
+/* keys are kept as a length byte and the key bytes */
+struct artBuffer {
+  int              cap;
+  int              cnt;
+  int              mask;
+  int*             table;
+  artBufferEntry*  ents;
+  artBufferEntry** order;
+  artBufferEntry** spare;
+  byte_t*          keys;
+  int              used;
+  int              size;
+};
+
+static word_t artBufferHash (byte_t* k, int l) {
+  word_t h = 2166136261UL;
+  int i;
+  for (i = 0; i < l; i++)
+    h = (h ^ k[i]) * 16777619UL;
+  return h;
+}
+
+static int artBufferSlot (artBuffer* b, byte_t* k, int l, word_t h) {
+  artBufferEntry* e;
+  byte_t* key;
+  int i = (int)(h & b->mask);
+  for (; b->table[i]; i = (i + 1) & b->mask) {
+    e = &b->ents[b->table[i] - 1];
+    key = b->keys + e->off;
+    if (e->hash == h && key[0] == l && !memcmp(key + 1, k, l))
+      break;
+  }
+  return i;
+}
+
+word_t* artBufferFind (artBuffer* b, byte_t* k, int l) {
+  int i;
+  if (!b->cnt) return NULL;
+  i = artBufferSlot(b, k, l, artBufferHash(k, l));
+  return b->table[i] ? &b->ents[b->table[i] - 1].val : NULL;
+}
+
+void artBufferPut (Art* art, byte_t* k, int l, word_t v, int dead) {
+  artBuffer* b = art->buffer;
+  artBufferEntry* e;
+  word_t h = artBufferHash(k, l);
+  int i = artBufferSlot(b, k, l, h), j;
+
+  if (!b->table[i]) {
+    if (b->cnt == b->cap) {
+      artFlush(art);
+      i = artBufferSlot(b, k, l, h);
+    }
+    if (b->used + l + 1 > b->size) {
+      b->size = b->size * 2 + l + 1;
+      b->keys = realloc(b->keys, b->size);
+      if (!b->keys) {
+        fprintf(stderr, "Fatal: out of memory.");
+        abort();
+      }
+    }
+    e = &b->ents[b->cnt++];
+    e->hash = h;
+    e->head = 0;
+    for (j = 0; j < (int)sizeof(word_t); j++)
+      e->head = e->head << 8 | (j < l ? k[j] : 0);
+    e->off = b->used;
+    b->keys[b->used] = (byte_t)l;
+    memcpy(b->keys + b->used + 1, k, l);
+    b->used += l + 1;
+    b->table[i] = b->cnt;
+  } else {
+    e = &b->ents[b->table[i] - 1];
+  }
+  e->val = v;
+  e->dead = dead;
+}
+
+static int artBufferCompare (artBuffer* b, artBufferEntry* p, artBufferEntry* q) {
+  byte_t* x = b->keys + p->off;
+  byte_t* y = b->keys + q->off;
+  int r = memcmp(x + 1, y + 1, x[0] < y[0] ? x[0] : y[0]);
+  return r ? r : x[0] - y[0];
+}
+
+/* merge sort of n entries by key, t holding at least n / 2 of scratch.
+ * short runs are left to an insertion sort. */
+static void artBufferMergeSort (artBuffer* b, artBufferEntry** a,
+                                artBufferEntry** t, int n) {
+  artBufferEntry* e;
+  int h = n / 2, i, j, k;
+
+  if (n < 16) {
+    for (i = 1; i < n; i++) {
+      e = a[i];
+      for (j = i; j > 0 && artBufferCompare(b, a[j - 1], e) > 0; j--)
+        a[j] = a[j - 1];
+      a[j] = e;
+    }
+    return;
+  }
+  artBufferMergeSort(b, a, t, h);
+  artBufferMergeSort(b, a + h, t, n - h);
+  if (artBufferCompare(b, a[h - 1], a[h]) < 0)
+    return;
+  memcpy(t, a, sizeof(artBufferEntry *) * h);
+  for (i = 0, j = h, k = 0; i < h && j < n; )
+    a[k++] = artBufferCompare(b, t[i], a[j]) < 0 ? t[i++] : a[j++];
+  while (i < h)
+    a[k++] = t[i++];
+}
+
+/* radix sort on head a byte at a time, skipping bytes every entry
+ * shares. entries with equal heads share their first word of key, or
+ * one is a zero padded prefix, and each run of them is merge sorted by
+ * comparing keys. */
+static void artBufferSort (artBuffer* b) {
+  artBufferEntry **a = b->order, **t = b->spare, **s;
+  int count[256], i, j, c, sum, shift, n = b->cnt;
+
+  for (i = 0; i < n; i++)
+    a[i] = &b->ents[i];
+  for (shift = 0; shift < (int)sizeof(word_t) * 8; shift += 8) {
+    memset(count, 0, sizeof(count));
+    for (i = 0; i < n; i++)
+      count[a[i]->head >> shift & 255]++;
+    if (count[a[0]->head >> shift & 255] == n)
+      continue;
+    for (i = sum = 0; i < 256; i++) {
+      c = count[i];
+      count[i] = sum;
+      sum += c;
+    }
+    for (i = 0; i < n; i++)
+      t[count[a[i]->head >> shift & 255]++] = a[i];
+    s = a;
+    a = t;
+    t = s;
+  }
+  if (a != b->order)
+    memcpy(b->order, a, sizeof(artBufferEntry *) * n);
+  a = b->order;
+  for (i = 0; i < n; i = j) {
+    for (j = i + 1; j < n && a[j]->head == a[i]->head; j++);
+    if (j - i > 1) artBufferMergeSort(b, a + i, b->spare, j - i);
+  }
+}
+
+void artFlush (Art* art) {
+  artBuffer* b = art->buffer;
+  artBufferEntry* e;
+  byte_t* key;
+  int i, n;
+
+  if (!b || !b->cnt) return;
+  artBufferSort(b);
+  /* empty to anything the writes below call back into */
+  n = b->cnt;
+  b->cnt = 0;
+  for (i = 0; i < n; i++) {
+    e = b->order[i];
+    key = b->keys + e->off;
+    if (e->dead) artRemoveEncoded(art, key + 1, key[0]);
+    else artExchangeEncoded(art, NULL, key + 1, key[0], e->val);
+  }
+  memset(b->table, 0, sizeof(int) * (b->mask + 1));
+  b->used = 0;
+}
+
+void artSetBuffer (Art* art, int n) {
+  artBuffer* b = art->buffer;
+  int size = 1;
+  if (b) {
+    artFlush(art);
+    free(b->table);
+    free(b->ents);
+    free(b->order);
+    free(b->spare);
+    free(b->keys);
+    free(b);
+    art->buffer = NULL;
+  }
+  if (n < 1 || (art->flags & ART_MULTI))
+    return;
+  while (size < 2 * n) size <<= 1;
+  b = artMalloc(sizeof(artBuffer));
+  b->cap = n;
+  b->mask = size - 1;
+  b->table = artMalloc(sizeof(int) * size);
+  b->ents = artMalloc(sizeof(artBufferEntry) * n);
+  b->order = artMalloc(sizeof(artBufferEntry *) * n);
+  b->spare = artMalloc(sizeof(artBufferEntry *) * n);
+  b->size = 16 * n;
+  b->keys = artMalloc(b->size);
+  art->buffer = b;
+}
+
+/* negative lookup filter
+ *   a split block bloom filter over the encoded keys. a key sets one bit
+ *   in each of the eight 32 bit words of a 32 byte block, so a miss is
+ *   decided by one cache line. puts add keys as they go; removals only
+ *   count, and artFilterRebuild rebuilds the filter from the tree once
+ *   they or new keys have made it stale. */
+
+#define ART_FILTER_BITS 16
+#define ART_MIX (((word_t)0x9e3779b9UL << 16 << 16) | 0x7f4a7c15UL)
+
+static const unsigned int artFilterSalt[8] = {
+  0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+  0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+};
+
+static word_t artFilterHash (byte_t* k, int l) {
+  word_t h = (word_t)l * ART_MIX, w;
+  int i;
+  for (i = 0; i + ART_WORD <= l; i += ART_WORD) {
+    memcpy(&w, k + i, ART_WORD);
+    h = (h ^ w) * ART_MIX;
+    h ^= h >> 29;
+  }
+  if (i < l) {
+    w = 0;
+    memcpy(&w, k + i, l - i);
+    h = (h ^ w) * ART_MIX;
+  }
+  h ^= h >> (ART_WORD * 4);
+  h *= ART_MIX;
+  return h ^ h >> (ART_WORD * 4);
+}
+
+void artFilterAdd (artFilter* f, byte_t* k, int l, int fresh) {
+  word_t h = artFilterHash(k, l);
+  unsigned int* b = f->blocks + 8 * (h >> (ART_WORD * 4) & f->mask);
+  unsigned int x = (unsigned int)h & 0xffffffffU;
+  int i;
+  for (i = 0; i < 8; i++)
+    b[i] |= 1U << ((x * artFilterSalt[i] & 0xffffffffU) >> 27);
+  f->keys += fresh;
+}
+
+int artFilterHas (artFilter* f, byte_t* k, int l) {
+  word_t h = artFilterHash(k, l);
+  unsigned int* b = f->blocks + 8 * (h >> (ART_WORD * 4) & f->mask);
+  unsigned int x = (unsigned int)h & 0xffffffffU, miss = 0;
+  int i;
+  for (i = 0; i < 8; i++)
+    miss |= ~b[i] & 1U << ((x * artFilterSalt[i] & 0xffffffffU) >> 27);
+  return !miss;
+}
+
+static int artFilterCount (void* ctx, byte_t* k, int l, word_t v) {
+  (void)k; (void)l; (void)v;
+  (*(word_t *)ctx)++;
+  return 0;
+}
+
+static int artFilterVisit (void* ctx, byte_t* k, int l, word_t v) {
+  (void)v;
+  artFilterAdd(ctx, k, l, 1);
+  return 0;
+}
+
+/* sized for the keys in the tree at ART_FILTER_BITS bits a key, in a
+ * power of two number of blocks */
+static void artFilterBuild (Art* art) {
+  artFilter* f = art->filter;
+  byte_t key[256];
+  word_t n = 0, blocks = 1;
+
+  if (art->root) __artWalk(art, art->root, 0, key, 0, artFilterCount, &n);
+  while (blocks * 256 < (n < 1024 ? 1024 : n) * ART_FILTER_BITS)
+    blocks <<= 1;
+  free(f->blocks);
+  f->blocks = artMalloc(blocks * 8 * sizeof(unsigned int));
+  f->mask = blocks - 1;
+  f->cap = blocks * 256 / ART_FILTER_BITS;
+  f->keys = 0;
+  f->removed = 0;
+  if (art->root) __artWalk(art, art->root, 0, key, 0, artFilterVisit, f);
+}
+
+void artSetFilter (Art* art, int on) {
+  if (art->filter && !on) {
+    free(art->filter->blocks);
+    free(art->filter);
+    art->filter = NULL;
+  }
+  if (!on) return;
+  artFlush(art);
+  if (!art->filter) art->filter = artMalloc(sizeof(artFilter));
+  artFilterBuild(art);
+}
+
+int artFilterRebuild (Art* art) {
+  artFilter* f = art->filter;
+  if (!f || (f->removed * 4 <= f->keys && f->keys <= f->cap * 2))
+    return 0;
+  artSetFilter(art, 1);
+  return 1;
+}
+
+/* change feed
+ *   a ring of records over a ring of key bytes, both a power of two in
+ *   size and indexed by ever growing counters. a record that would
+ *   overrun either ring drops the oldest ones, and readers that were
+ *   still behind them are told to resync. */
+
+typedef struct {
+  word_t pos;
+  word_t val;
+  int    op;
+  int    len;
+} artFeedRecord;
+
+struct artFeed {
+  artFeedRecord* recs;
+  word_t         mask;
+  byte_t*        data;
+  word_t         size;
+  word_t         head;
+  word_t         first;
+  word_t         next;
+};
+
+void artFeedAppend (artFeed* f, int op, byte_t* k, int l, word_t v) {
+  artFeedRecord* r;
+  word_t at;
+  int n;
+
+  while (f->next - f->first > f->mask ||
+         (f->next > f->first &&
+          f->head + l - f->recs[f->first & f->mask].pos > f->size))
+    f->first++;
+  at = f->head & (f->size - 1);
+  n = f->size - at < (word_t)l ? (int)(f->size - at) : l;
+  memcpy(f->data + at, k, n);
+  memcpy(f->data, k + n, l - n);
+  r = &f->recs[f->next++ & f->mask];
+  r->pos = f->head;
+  r->val = v;
+  r->op = op;
+  r->len = l;
+  f->head += l;
+}
+
+void artSetFeed (Art* art, int n) {
+  artFeed* f = art->feed;
+  word_t size = 1;
+  if (f) {
+    free(f->recs);
+    free(f->data);
+    free(f);
+    art->feed = NULL;
+  }
+  if (n < 1 || (art->flags & ART_MULTI))
+    return;
+  while (size < (word_t)n) size <<= 1;
+  f = artMalloc(sizeof(artFeed));
+  f->recs = artMalloc(size * sizeof(artFeedRecord));
+  f->mask = size - 1;
+  f->size = size * 32 < 4096 ? 4096 : size * 32;
+  f->data = artMalloc(f->size);
+  art->feed = f;
+}
+
+word_t artFeedSeq (Art* art) {
+  return art->feed ? art->feed->next : 0;
+}
+
+int artFeedRead (Art* art, word_t* seq, artChange* out, int max) {
+  artFeed* f = art->feed;
+  artFeedRecord* r;
+  word_t at;
+  int i, n;
+
+  if (!f || *seq < f->first || *seq > f->next)
+    return -1;
+  for (i = 0; i < max && *seq < f->next; i++, (*seq)++) {
+    r = &f->recs[*seq & f->mask];
+    at = r->pos & (f->size - 1);
+    n = f->size - at < (word_t)r->len ? (int)(f->size - at) : r->len;
+    memcpy(out[i].key, f->data + at, n);
+    memcpy(out[i].key + n, f->data, r->len - n);
+    out[i].seq = *seq;
+    out[i].val = r->val;
+    out[i].op = r->op;
+    out[i].len = r->len;
+  }
+  return i;
+}
+
+void artFeedApply (Art* art, artChange* c, int n) {
+  int i;
+  artFlush(art);
+  for (i = 0; i < n; i++) {
+    if (c[i].op == ART_FEED_REMOVE) artRemoveEncoded(art, c[i].key, c[i].len);
+    else artExchangeEncoded(art, NULL, c[i].key, c[i].len, c[i].val);
+  }
+}
+
+/* cache
+ *   a CLOCK over the keys in key order. the hand is the last key looked
+ *   at, and a sweep seeks a cursor to it and walks on, wrapping at the
+ *   end. referenced keys lose their bit and are passed over, the rest
+ *   are removed until the tree is within budget. every bit a sweep
+ *   clears was set by a get, so the work per put stays amortized O(1). */
+
+struct artCache {
+  word_t     budget;
+  artEvictFn fn;
+  void*      ctx;
+  int        hlen;
+  byte_t     hand[256];
+  artCursor  cursor;
+};
+
+Art* artNewCache (word_t budget, artEvictFn fn, void* ctx) {
+  Art* d = artNewWith(ART_CACHE, sizeof(word_t));
+  d->cache = artMalloc(sizeof(artCache));
+  d->cache->budget = budget;
+  d->cache->fn = fn;
+  d->cache->ctx = ctx;
+  return d;
+}
+
+/* k, the key just put, is never evicted for its own put */
+void artCacheEvict (Art* art, byte_t* k, int l) {
+  artCache* c = art->cache;
+  artCursor* cur = &c->cursor;
+  artNode* n;
+  word_t v;
+  int seen = 1;
+
+  if (art->bytes <= c->budget) return;
+  artCursorSeek(art, cur, c->hand, c->hlen);
+  while (art->bytes > c->budget) {
+    if (!artCursorNext(cur)) {
+      /* a lap without a single key */
+      if (!seen) break;
+      seen = 0;
+      artCursorSeek(art, cur, c->hand, 0);
+      continue;
+    }
+    if (cur->len == l && !memcmp(cur->key, k, l))
+      continue;
+    seen = 1;
+    n = cur->stack[cur->depth - 1].node;
+    if (ART_USED(art, n)) {
+      ART_USED(art, n) = 0;
+      continue;
+    }
+    memcpy(c->hand, cur->key, cur->len);
+    c->hlen = cur->len;
+    v = cur->val;
+    artRemoveEncoded(art, c->hand, c->hlen);
+    if (c->fn) c->fn(c->ctx, c->hand, c->hlen, v);
+    artCursorSeek(art, cur, c->hand, c->hlen);
+  }
+  if (cur->depth && cur->val) {
+    memcpy(c->hand, cur->key, cur->len);
+    c->hlen = cur->len;
+  }
+}
+
+/* merkle
+ *   ART_MERKLE trees keep in the word in front of every node the sum of
+ *   a hash of each key below it with its value. a sum does not depend on
+ *   the shape of the tree, so two trees holding the same keys agree on
+ *   every subtree they share, however they were built. a write moves
+ *   the hash of every node along its path by the change in its key's
+ *   hash. nodes the write allocated start at zero, and are summed from
+ *   their children instead. */
+
+#define ART_HASH(a, n) (*(word_t *)((byte_t *)(n) - (a)->ext))
+
+static word_t artMerkleKey (byte_t* k, int l, word_t v) {
+  word_t h = artFilterHash(k, l) ^ v;
+  h *= ART_MIX;
+  h ^= h >> (ART_WORD * 4);
+  h *= ART_MIX;
+  return h ^ h >> 29;
+}
+
+/* l is the length of n's own key, which k holds */
+static void artNodeRehash (Art* art, artNode* n, byte_t* k, int l) {
+  byte_t keys[256];
+  artNode* kids[256];
+  word_t v = artNodeGetVal(n), h = v ? artMerkleKey(k, l, v) : 0;
+  int i, c = artNodeChildren(art, n, keys, kids);
+  for (i = 0; i < c; i++)
+    h += ART_HASH(art, kids[i]);
+  ART_HASH(art, n) = h;
+}
+
+/* the nodes artScorePath visits, each with its own key. the first m
+ * of them hold k below them, and a node whose prefix stops matching
+ * does not. */
+void artMerklePath (Art* art, byte_t* k, int l, word_t old, word_t v) {
+  artNode* path[257];
+  int ends[257];
+  byte_t key[256];
+  artNode* n = art->root;
+  word_t delta = (v ? artMerkleKey(k, l, v) : 0) - (old ? artMerkleKey(k, l, old) : 0);
+  int d = 0, m = 0, i = 0;
+  while (n) {
+    memcpy(key + i, artNodeGetPrefix(n), n->head.plen);
+    ends[d] = i + n->head.plen;
+    path[d++] = n;
+    if (artNodeCheckPrefix(n, k, l, i) != n->head.plen) break;
+    m = d;
+    i += n->head.plen;
+    if (i >= l) break;
+    n = artNodeGetChild(art, n, k[i]);
+  }
+  while (d--) {
+    if (!ART_HASH(art, path[d]))
+      artNodeRehash(art, path[d], key, ends[d]);
+    else if (d < m)
+      ART_HASH(art, path[d]) += delta;
+  }
+}
+
+Art* artNewMerkle (void) {
+  return artNewWith(ART_MERKLE, sizeof(word_t));
+}
+
+word_t artRootHash (Art* art) {
+  artFlush(art);
+  if (!(art->flags & ART_MERKLE) || !art->root)
+    return 0;
+  return ART_HASH(art, art->root);
+}
+
+typedef struct {
+  artJoinVisitor fn;
+  void*          ctx;
+  int            side;
+} artDiffSide;
+
+static int artDiffVisitor (void* ctx, byte_t* k, int l, word_t v) {
+  artDiffSide* s = ctx;
+  return s->side ? s->fn(s->ctx, k, l, 0, v) : s->fn(s->ctx, k, l, v, 0);
+}
+
+/* a subtree only one side holds */
+static int artDiffWalk (Art* art, artNode* n, int off, byte_t* key, int depth,
+                        int side, artJoinVisitor fn, void* ctx) {
+  artDiffSide s;
+  s.fn = fn;
+  s.ctx = ctx;
+  s.side = side;
+  return __artWalk(art, n, off, key, depth, artDiffVisitor, &s);
+}
+
+/* the first branch of n at byte from or above. a node partway through
+ * its path has one branch, itself, at the next byte of the path. */
+static artNode* artDiffBranch (Art* art, artNode* n, int off, int from, int* b, int* noff) {
+  byte_t e;
+  artNode* t;
+  *noff = off < n->head.plen ? off : 0;
+  if (off < n->head.plen) {
+    *b = artNodeGetPrefix(n)[off];
+    return *b >= from ? n : NULL;
+  }
+  t = artNodeNextChild(art, n, from, &e);
+  *b = e;
+  return t;
+}
+
+/* a and b cover the same key bytes, as in __artIntersect, and either
+ * may be missing. subtrees with equal hashes hold the same keys. */
+static int __artDiff (Art* A, artNode* a, int ai, Art* B, artNode* b, int bi,
+                      byte_t* key, int depth, artJoinVisitor fn, void* ctx) {
+  byte_t *pa, *pb;
+  artNode *ta, *tb;
+  word_t va, vb;
+  int ca = 0, cb = 0, ka, kb, oa, ob;
+
+  if (!b) return artDiffWalk(A, a, ai, key, depth, 0, fn, ctx);
+  if (!a) return artDiffWalk(B, b, bi, key, depth, 1, fn, ctx);
+  if ((A->flags & B->flags & ART_MERKLE) && ART_HASH(A, a) == ART_HASH(B, b))
+    return 0;
+
+  pa = artNodeGetPrefix(a);
+  pb = artNodeGetPrefix(b);
+  for (; ai < a->head.plen && bi < b->head.plen; ai++, bi++) {
+    if (pa[ai] < pb[bi])
+      return artDiffWalk(A, a, ai, key, depth, 0, fn, ctx)
+          || artDiffWalk(B, b, bi, key, depth, 1, fn, ctx);
+    if (pa[ai] > pb[bi])
+      return artDiffWalk(B, b, bi, key, depth, 1, fn, ctx)
+          || artDiffWalk(A, a, ai, key, depth, 0, fn, ctx);
+    key[depth++] = pa[ai];
+  }
+
+  va = ai < a->head.plen ? 0 : artNodeGetVal(a);
+  vb = bi < b->head.plen ? 0 : artNodeGetVal(b);
+  if (va != vb && fn(ctx, key, depth, va, vb))
+    return 1;
+
+  for (;;) {
+    ta = artDiffBranch(A, a, ai, ca, &ka, &oa);
+    tb = artDiffBranch(B, b, bi, cb, &kb, &ob);
+    if (ta && tb && ka == kb) {
+      if (__artDiff(A, ta, oa, B, tb, ob, key, depth, fn, ctx))
+        return 1;
+      ca = cb = ka + 1;
+    } else if (ta && (!tb || ka < kb)) {
+      if (__artDiff(A, ta, oa, B, NULL, 0, key, depth, fn, ctx))
+        return 1;
+      ca = ka + 1;
+    } else if (tb) {
+      if (__artDiff(A, NULL, 0, B, tb, ob, key, depth, fn, ctx))
+        return 1;
+      cb = kb + 1;
+    } else return 0;
+  }
+}
+
+void artDiff (Art* a, Art* b, artJoinVisitor fn, void* ctx) {
+  byte_t key[256];
+  artFlush(a);
+  artFlush(b);
+  if (!a->root && !b->root) return;
+  __artDiff(a, a->root, 0, b, b->root, 0, key, 0, fn, ctx);
+}
+
+/* teardown
+ *   compact trees drop their chunks whole, so their nodes are only
+ *   visited for heap prefixes and postings. */
+static void __artFree (Art* art, artNode* n) {
+  byte_t keys[256];
+  artNode* kids[256];
+  word_t v;
+  int i, c;
+
+  c = artNodeChildren(art, n, keys, kids);
+  for (i = 0; i < c; i++)
+    __artFree(art, kids[i]);
+  if ((art->flags & ART_MULTI) && (v = artNodeGetVal(n)))
+    free((void *)v);
+#ifdef ART_COMPACT
+  if (n->head.plen > sizeof(word_t))
+    free((void *)artArrayToWord(n->head.path));
+#else
+  artNodeFree(art, n);
+#endif
+}
+
+void artFree (Art* art) {
+  artQueueBlock *b, *t;
+#ifdef ART_COMPACT
+  artChunkTable* table = art->arena->table;
+  int i;
+#endif
+
+  /* pending writes die with the tree */
+  if (art->buffer) {
+    art->buffer->cnt = 0;
+    artSetBuffer(art, 0);
+  }
+  artSetFilter(art, 0);
+  artSetFeed(art, 0);
+  free(art->cache);
+  if (art->root) __artFree(art, art->root);
+  if (art->lazy) {
+    for (b = ((artQueue *)art->lazy)->head; b; b = t) {
+      t = b->next;
+      free(b);
+    }
+    free(art->lazy);
+  }
+#ifdef ART_COMPACT
+  for (i = 0; i < table->nchunks; i++)
+    free(((byte_t **)table->chunks[i])[1]);
+#ifndef ART_NO_THREADS
+  pthread_mutex_destroy(&table->lock);
+#endif
+  free(table->chunks);
+  free(table);
+  free(art->arena);
+#endif
+  if (!(art->flags & ART_PRIVATE)) bytes -= art->bytes;
+  free(art);
+}
+
+/* traversal
+ *   artNodeChildren lists the children of any node type ordered by their
+ *   key byte, so every walk below visits keys in sorted order. */
+
+int artNodeChildren (Art* art, artNode* n, byte_t* keys, artNode** kids) {
+  artNodeSingle* p;
+  artNodeLinear* l;
+  artNodeLinear16* l16;
+  artNodeSpan* s;
+  artNodeRadix* r;
+  artNode* t;
+  byte_t b;
+  int i, j, c = 0;
+
+  switch (n->head.type) {
+  case _SINGLE:
+    p = (artNodeSingle *)n;
+    if (p->radix) {
+      keys[c] = p->map;
+      kids[c++] = ART_NODE(art, p->radix);
+    }
+  break;
+  case _INNER:
+  case _LINEAR:
+    l = (artNodeLinear *)n;
+    for (i = 0; i < _LINEAR; i++) {
+      if (l->radix[i]) {
+        keys[c] = l->map[i];
+        kids[c++] = ART_NODE(art, l->radix[i]);
+      }
+    }
+  break;
+  case _LINEAR16:
+  case _INNER16:
+    l16 = (artNodeLinear16 *)n;
+    for (i = 0; i < _LINEAR16; i++) {
+      if (l16->radix[i]) {
+        keys[c] = l16->map[i];
+        kids[c++] = ART_NODE(art, l16->radix[i]);
+      }
+    }
+  break;
+  case _SPAN:
+  case _INNER48:
+    s = (artNodeSpan *)n;
+    for (i = 0; i < 256; i++) {
+      if (artSpanHas(s, i)) {
+        keys[c] = (byte_t)i;
+        kids[c] = ART_NODE(art, s->radix[c]);
+        c++;
+      }
+    }
+    return c;
+  case _RADIX:
+    r = (artNodeRadix *)n;
+    for (i = 0; i < 256; i++) {
+      if (r->radix[i]) {
+        keys[c] = (byte_t)i;
+        kids[c++] = ART_NODE(art, r->radix[i]);
+      }
+    }
+    return c;
+  default: return 0;
+  }
+
+  /* linear maps are unordered */
+  for (i = 1; i < c; i++) {
+    b = keys[i];
+    t = kids[i];
+    for (j = i; j > 0 && keys[j - 1] > b; j--) {
+      keys[j] = keys[j - 1];
+      kids[j] = kids[j - 1];
+    }
+    keys[j] = b;
+    kids[j] = t;
+  }
+  return c;
+}
+
+/* the child with the smallest key byte not below b, with that byte in
+ * *e, or NULL */
+artNode* artNodeNextChild (Art* art, artNode* n, int b, byte_t* e) {
+  artNodeSingle* p;
+  artNodeLinear* l;
+  artNodeLinear16* l16;
+  artNodeSpan* s;
+  artNodeRadix* r;
+  artRef ref = 0;
+  int i, best = 256;
+
+  switch (n->head.type) {
+  case _SINGLE:
+    p = (artNodeSingle *)n;
+    if (p->radix && p->map >= b) {
+      best = p->map;
+      ref = p->radix;
+    }
+  break;
+  case _INNER:
+  case _LINEAR:
+    l = (artNodeLinear *)n;
+    for (i = 0; i < _LINEAR; i++) {
+      if (l->radix[i] && l->map[i] >= b && l->map[i] < best) {
+        best = l->map[i];
+        ref = l->radix[i];
+      }
+    }
+  break;
+  case _LINEAR16:
+  case _INNER16:
+    l16 = (artNodeLinear16 *)n;
+    for (i = 0; i < _LINEAR16; i++) {
+      if (l16->radix[i] && l16->map[i] >= b && l16->map[i] < best) {
+        best = l16->map[i];
+        ref = l16->radix[i];
+      }
+    }
+  break;
+  case _SPAN:
+  case _INNER48:
+    s = (artNodeSpan *)n;
+    for (i = b; i < 256 && !artSpanHas(s, i); i++);
+    if (i < 256) {
+      best = i;
+      ref = s->radix[artSpanRank(s, i)];
+    }
+  break;
+  case _RADIX:
+    r = (artNodeRadix *)n;
+    for (i = b; i < 256 && !r->radix[i]; i++);
+    if (i < 256) {
+      best = i;
+      ref = r->radix[i];
+    }
+  break;
+  default: break;
+  }
+
+  *e = (byte_t)best;
+  return ART_NODE(art, ref);
+}
+
+/* cursors
+ *   a frame per node on the path to the current key. next is -1 while
+ *   the node's own value is still to come, then the lowest key byte of
+ *   the children not yet entered. */
+
+static void artCursorPush (artCursor* c, artNode* n, int len, int next) {
+  artCursorFrame* f = &c->stack[c->depth++];
+  memcpy(c->key + len, artNodeGetPrefix(n), n->head.plen);
+  f->node = n;
+  f->next = next;
+  f->len = len + n->head.plen;
+}
+
+void artCursorSeek (Art* art, artCursor* c, byte_t* k, int l) {
+  artCursorFrame* f;
+  artNode* n;
+  int d = 0, m, r;
+
+  artFlush(art);
+  n = art->root;
+  c->art = art;
+  c->depth = 0;
+  c->len = 0;
+  c->val = 0;
+  while (n) {
+    artCursorPush(c, n, d, -1);
+    f = &c->stack[c->depth - 1];
+    m = n->head.plen < l - d ? n->head.plen : l - d;
+    r = memcmp(c->key + d, k + d, m);
+    /* every key below sorts after k, or all of them before it */
+    if (r > 0 || (!r && n->head.plen > l - d))
+      return;
+    if (r < 0) {
+      f->next = 256;
+      return;
+    }
+    d += n->head.plen;
+    if (d == l)
+      return;
+    f->next = k[d] + 1;
+    n = artNodeGetChild(art, n, k[d]);
+  }
+}
+
+int artCursorNext (artCursor* c) {
+  artCursorFrame* f;
+  artNode* n;
+  byte_t e;
+
+  while (c->depth) {
+    f = &c->stack[c->depth - 1];
+    if (f->next < 0) {
+      f->next = 0;
+      c->len = f->len;
+      if ((c->val = artNodeGetVal(f->node)))
+        return 1;
+    }
+    n = f->next < 256 ? artNodeNextChild(c->art, f->node, f->next, &e) : NULL;
+    if (!n) {
+      c->depth--;
+      continue;
+    }
+    f->next = e + 1;
+    artCursorPush(c, n, f->len, -1);
+  }
+  c->val = 0;
+  return 0;
+}
+
+/* visits every key below n. the first off bytes of n's prefix are
+ * already in key. returns non-zero if the visitor stopped the walk. */
+int __artWalk (Art* art, artNode* n, int off, byte_t* key, int depth,
+               artVisitor fn, void* ctx) {
+  byte_t keys[256];
+  artNode* kids[256];
+  word_t v;
+  int i, c;
+
+  memcpy(key + depth, artNodeGetPrefix(n) + off, n->head.plen - off);
+  depth += n->head.plen - off;
+  v = artNodeGetVal(n);
+  if (v && fn(ctx, key, depth, v))
+    return 1;
+  c = artNodeChildren(art, n, keys, kids);
+  for (i = 0; i < c; i++) {
+    if (__artWalk(art, kids[i], 0, key, depth, fn, ctx))
+      return 1;
+  }
+  return 0;
+}
+
+/* fuzzy search
+ *   keeps one levenshtein row per key byte. a node's prefix is consumed a
+ *   byte at a time, and once every entry of the last row exceeds the
+ *   edit budget no key below can come back within it. */
+
+int __artFuzzy (Art* art, artNode* n, byte_t* key, int depth, int* rows,
+                byte_t* q, int len, int max, artVisitor fn, void* ctx) {
+  byte_t keys[256];
+  artNode* kids[256];
+  byte_t* p = artNodeGetPrefix(n);
+  int *prev, *row, i, j, c, low, best;
+  word_t v;
+
+  for (i = 0; i < n->head.plen; i++, depth++) {
+    prev = rows + depth * (len + 1);
+    row = prev + len + 1;
+    key[depth] = p[i];
+    row[0] = low = depth + 1;
+    for (j = 1; j <= len; j++) {
+      best = prev[j - 1] + (q[j - 1] != p[i]);
+      if (prev[j] + 1 < best) best = prev[j] + 1;
+      if (row[j - 1] + 1 < best) best = row[j - 1] + 1;
+      row[j] = best;
+      if (best < low) low = best;
+    }
+    if (low > max) return 0;
+  }
+  v = artNodeGetVal(n);
+  if (v && rows[depth * (len + 1) + len] <= max && fn(ctx, key, depth, v))
+    return 1;
+  c = artNodeChildren(art, n, keys, kids);
+  for (i = 0; i < c; i++) {
+    if (__artFuzzy(art, kids[i], key, depth, rows, q, len, max, fn, ctx))
+      return 1;
+  }
+  return 0;
+}
+
+void artFuzzySearch (Art* art, byte_t* q, int len, int max, artVisitor fn, void* ctx) {
+  byte_t key[256];
+  int* rows;
+  int j;
+
+  if (len > 255 || max < 0) return;
+  artFlush(art);
+  rows = artMalloc(sizeof(int) * (len + 1) * 256);
+  for (j = 0; j <= len; j++) rows[j] = j;
+  __artFuzzy(art, art->root, key, 0, rows, q, len, max, fn, ctx);
+  free(rows);
+}
+
+/* set operations
+ *   both trees are descended together. a and b cover the same key bytes
+ *   and ai, bi count how much of their compressed paths is consumed. when
+ *   one side ends its path first, only the child matching the other
+ *   side's next byte can hold common keys, so the rest is never read. */
+
+int __artIntersect (Art* A, artNode* a, int ai, Art* B, artNode* b, int bi,
+                    byte_t* key, int depth, artJoinVisitor fn, void* ctx) {
+  byte_t keys[256], *pa, *pb;
+  artNode *kids[256], *t;
+  word_t va, vb;
+  int i, c;
+
+  pa = artNodeGetPrefix(a);
+  pb = artNodeGetPrefix(b);
+  for (; ai < a->head.plen && bi < b->head.plen; ai++, bi++) {
+    if (pa[ai] != pb[bi]) return 0;
+    key[depth++] = pa[ai];
+  }
+
+  if (ai < a->head.plen) {
+    t = artNodeGetChild(B, b, pa[ai]);
+    if (!t) return 0;
+    return __artIntersect(A, a, ai, B, t, 0, key, depth, fn, ctx);
+  }
+  if (bi < b->head.plen) {
+    t = artNodeGetChild(A, a, pb[bi]);
+    if (!t) return 0;
+    return __artIntersect(A, t, 0, B, b, bi, key, depth, fn, ctx);
+  }
+
+  va = artNodeGetVal(a);
+  vb = artNodeGetVal(b);
+  if (va && vb && fn(ctx, key, depth, va, vb))
+    return 1;
+
+  /* list the smaller side and probe the other */
+  if (a->head.rcnt <= b->head.rcnt) {
+    c = artNodeChildren(A, a, keys, kids);
+    for (i = 0; i < c; i++) {
+      t = artNodeGetChild(B, b, keys[i]);
+      if (t && __artIntersect(A, kids[i], 0, B, t, 0, key, depth, fn, ctx))
+        return 1;
+    }
+  } else {
+    c = artNodeChildren(B, b, keys, kids);
+    for (i = 0; i < c; i++) {
+      t = artNodeGetChild(A, a, keys[i]);
+      if (t && __artIntersect(A, t, 0, B, kids[i], 0, key, depth, fn, ctx))
+        return 1;
+    }
+  }
+  return 0;
+}
+
+int __artDifference (Art* A, artNode* a, int ai, Art* B, artNode* b, int bi,
+                     byte_t* key, int depth, artVisitor fn, void* ctx) {
+  byte_t keys[256], *pa, *pb;
+  artNode *kids[256], *t;
+  word_t va;
+  int i, c;
+
+  if (!b)
+    return __artWalk(A, a, ai, key, depth, fn, ctx);
+
+  pa = artNodeGetPrefix(a);
+  pb = artNodeGetPrefix(b);
+  for (; ai < a->head.plen && bi < b->head.plen; ai++, bi++) {
+    if (pa[ai] != pb[bi])
+      return __artWalk(A, a, ai, key, depth, fn, ctx);
+    key[depth++] = pa[ai];
+  }
+
+  if (ai < a->head.plen) {
+    t = artNodeGetChild(B, b, pa[ai]);
+    return __artDifference(A, a, ai, B, t, 0, key, depth, fn, ctx);
+  }
+
+  va = artNodeGetVal(a);
+  c = artNodeChildren(A, a, keys, kids);
+
+  if (bi < b->head.plen) {
+    /* b holds nothing at this depth and one subtree below it */
+    if (va && fn(ctx, key, depth, va))
+      return 1;
+    for (i = 0; i < c; i++) {
+      t = keys[i] == pb[bi] ? b : NULL;
+      if (__artDifference(A, kids[i], 0, B, t, bi, key, depth, fn, ctx))
+        return 1;
+    }
+    return 0;
+  }
+
+  if (va && !artNodeGetVal(b) && fn(ctx, key, depth, va))
+    return 1;
+  for (i = 0; i < c; i++) {
+    t = artNodeGetChild(B, b, keys[i]);
+    if (__artDifference(A, kids[i], 0, B, t, 0, key, depth, fn, ctx))
+      return 1;
+  }
+  return 0;
+}
+
+void artIntersect (Art* a, Art* b, artJoinVisitor fn, void* ctx) {
+  byte_t key[256];
+  artFlush(a);
+  artFlush(b);
+  if (!a->root || !b->root) return;
+  __artIntersect(a, a->root, 0, b, b->root, 0, key, 0, fn, ctx);
+}
+
+void artDifference (Art* a, Art* b, artVisitor fn, void* ctx) {
+  byte_t key[256];
+  artFlush(a);
+  artFlush(b);
+  if (!a->root) return;
+  __artDifference(a, a->root, 0, b, b->root, 0, key, 0, fn, ctx);
+}
+
+/* optimize
+ *   removals only shrink a node when it crosses a size boundary and only
+ *   fold a chain at the node they emptied. this pass rebuilds every node
+ *   as its smallest type, packs and sorts child maps and folds single
+ *   child nodes without values into their child's prefix. */
+
+static void __artOptimize (Art* art, artNode** n) {
+  byte_t keys[256];
+  artNode* kids[256];
+  artNode* m;
+  word_t h = (art->flags & ART_MERKLE) ? ART_HASH(art, *n) : 0;
+  int i, c;
+
+  c = artNodeChildren(art, *n, keys, kids);
+  for (i = 0; i < c; i++) {
+    m = kids[i];
+    __artOptimize(art, &m);
+    if (m != kids[i])
+      artNodeReplaceChild(art, *n, m, keys[i]);
+  }
+  artNodeRebuild(art, n);
+  if ((*n)->head.rcnt == 1 && !artNodeGetVal(*n))
+    artNodeMergeWithChild(art, n);
+  if (art->flags & ART_SCORED)
+    artNodeRescore(art, *n);
+  /* the keys below are the same, and so is their hash */
+  if (art->flags & ART_MERKLE)
+    ART_HASH(art, *n) = h;
+}
+
+/* optimizes the subtree of the first root child at or after *pos and
+ * moves *pos past it. the root itself is done last, leaving *pos at 256.
+ * returns the node bytes reclaimed. */
+word_t artOptimizeStep (Art* art, int* pos) {
+  byte_t keys[256];
+  artNode* kids[256];
+  artNode* m;
+  word_t before = art->bytes, h;
+  int i, c;
+
+  artFlush(art);
+  c = artNodeChildren(art, art->root, keys, kids);
+  for (i = 0; i < c && keys[i] < *pos; i++);
+  if (i < c) {
+    m = kids[i];
+    __artOptimize(art, &m);
+    if (m != kids[i])
+      artNodeReplaceChild(art, art->root, m, keys[i]);
+    *pos = keys[i] + 1;
+  }
+  if (i + 1 >= c) {
+    h = (art->flags & ART_MERKLE) ? ART_HASH(art, art->root) : 0;
+    artNodeRebuild(art, &art->root);
+    if (art->flags & ART_SCORED)
+      artNodeRescore(art, art->root);
+    if (art->flags & ART_MERKLE)
+      ART_HASH(art, art->root) = h;
+    *pos = 256;
+  }
+  return before - art->bytes;
+}
+
+word_t artOptimize (Art* art) {
+  word_t freed = 0;
+  int pos = 0;
+  while (pos < 256)
+    freed += artOptimizeStep(art, &pos);
+  return freed;
+}
+
+/* files
+ *   whole files are mapped read-only, or read into memory when built
+ *   with ART_NO_MMAP. empty files give NULL. */
+
+static byte_t* artMapFile (char* path, word_t* size) {
+#ifndef ART_NO_MMAP
+  struct stat st;
+  void* m;
+  int fd = open(path, O_RDONLY);
+
+  if (fd < 0) return NULL;
+  if (fstat(fd, &st) || st.st_size < 1) {
+    close(fd);
+    return NULL;
+  }
+  *size = st.st_size;
+  m = mmap(NULL, *size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  return m == MAP_FAILED ? NULL : m;
+#else
+  FILE* in = fopen(path, "rb");
+  byte_t* base;
+  long end;
+
+  if (!in) return NULL;
+  if (fseek(in, 0, SEEK_END) || (end = ftell(in)) < 1) {
+    fclose(in);
+    return NULL;
+  }
+  *size = end;
+  base = artMalloc(*size);
+  rewind(in);
+  if (fread(base, 1, *size, in) != *size) {
+    fclose(in);
+    free(base);
+    return NULL;
+  }
+  fclose(in);
+  return base;
+#endif
+}
+
+static void artUnmapFile (byte_t* base, word_t size) {
+#ifndef ART_NO_MMAP
+  munmap(base, size);
+#else
+  free(base);
+#endif
+}
+
+/* frozen trees
+ *   a node is a flag byte, its prefix length and prefix, its value when
+ *   it has one, and when it has children their count less one, their
+ *   sorted key bytes and 32 bit offsets from the node to each child.
+ *   a child's prefix leaves out the key byte that leads to it. nodes
+ *   follow their parent in depth first order with no padding, so a
+ *   small node usually shares a cache line with its first child. */
+
+#define ART_FROZEN_VAL   1
+#define ART_FROZEN_KIDS  2
+#define ART_FROZEN_MAGIC 0x46545241
+
+typedef struct {
+  unsigned int magic;
+  unsigned int word;
+  word_t       count;
+  word_t       size;
+} artFrozenHeader;
+
+typedef struct {
+  byte_t* p;
+  word_t  len;
+  word_t  cap;
+  word_t  count;
+  int     err;
+} artFrozenBuf;
+
+static byte_t* artFrozenGrow (artFrozenBuf* b, word_t n) {
+  byte_t* p;
+  if (b->len + n > b->cap) {
+    while (b->len + n > b->cap) b->cap *= 2;
+    b->p = realloc(b->p, b->cap);
+    if (!b->p) {
+      fprintf(stderr, "Fatal: out of memory.");
+      abort();
+    }
+  }
+  p = b->p + b->len;
+  b->len += n;
+  return p;
+}
+
+/* returns the offset of the node in the block */
+static word_t __artFreeze (Art* art, artNode* n, int skip, artFrozenBuf* b) {
+  byte_t keys[256];
+  artNode* kids[256];
+  word_t at = b->len, v = artNodeGetVal(n), slot, off;
+  int c = artNodeChildren(art, n, keys, kids), plen = n->head.plen - skip, i;
+  unsigned int rel;
+  byte_t* p;
+
+  p = artFrozenGrow(b, 2 + plen + (v ? sizeof(word_t) : 0) + (c ? 1 + 5 * c : 0));
+  p[0] = (byte_t)((v ? ART_FROZEN_VAL : 0) | (c ? ART_FROZEN_KIDS : 0));
+  p[1] = (byte_t)plen;
+  memcpy(p + 2, artNodeGetPrefix(n) + skip, plen);
+  p += 2 + plen;
+  if (v) {
+    memcpy(p, &v, sizeof(word_t));
+    p += sizeof(word_t);
+    b->count++;
+  }
+  if (!c) return at;
+  p[0] = (byte_t)(c - 1);
+  memcpy(p + 1, keys, c);
+  slot = p + 1 + c - b->p;
+  for (i = 0; i < c; i++) {
+    off = __artFreeze(art, kids[i], 1, b) - at;
+    if (off > 0xffffffffUL) b->err = 1;
+    rel = (unsigned int)off;
+    memcpy(b->p + slot + 4 * i, &rel, 4);
+  }
+  return at;
+}
+
+artFrozen* artFreeze (Art* art) {
+  artFrozenBuf b;
+  artFrozenHeader h;
+  artFrozen* f;
+
+  if (art->flags & ART_MULTI)
+    return NULL;
+  artFlush(art);
+  b.cap = 4096;
+  b.p = artMalloc(b.cap);
+  b.len = sizeof(artFrozenHeader);
+  b.count = 0;
+  b.err = 0;
+  if (art->root) __artFreeze(art, art->root, 0, &b);
+  else memset(artFrozenGrow(&b, 2), 0, 2);
+  if (b.err) {
+    free(b.p);
+    return NULL;
+  }
+  h.magic = ART_FROZEN_MAGIC;
+  h.word = sizeof(word_t);
+  h.count = b.count;
+  h.size = b.len;
+  memcpy(b.p, &h, sizeof(h));
+  f = artMalloc(sizeof(artFrozen));
+  f->base = realloc(b.p, b.len);
+  if (!f->base) f->base = b.p;
+  f->root = f->base + sizeof(artFrozenHeader);
+  f->size = b.len;
+  f->count = b.count;
+  f->mapped = 0;
+  return f;
+}
+
+static word_t artFrozenVal (byte_t* n) {
+  word_t v;
+  if (!(n[0] & ART_FROZEN_VAL)) return 0;
+  memcpy(&v, n + 2 + n[1], sizeof(word_t));
+  return v;
+}
+
+/* the child count byte, or NULL for a node without children */
+static byte_t* artFrozenKids (byte_t* n) {
+  if (!(n[0] & ART_FROZEN_KIDS)) return NULL;
+  return n + 2 + n[1] + (n[0] & ART_FROZEN_VAL ? sizeof(word_t) : 0);
+}
+
+/* index of the first child key not less than b */
+static int artFrozenFind (byte_t* q, byte_t b) {
+  int lo = 0, hi = q[0] + 1, mid;
+  if (hi <= 8) {
+    while (lo < hi && q[1 + lo] < b) lo++;
+    return lo;
+  }
+  while (lo < hi) {
+    mid = (lo + hi) >> 1;
+    if (q[1 + mid] < b) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+static byte_t* artFrozenChild (byte_t* n, byte_t* q, int i) {
+  unsigned int rel;
+  memcpy(&rel, q + 2 + q[0] + 4 * i, 4);
+  return n + rel;
+}
+
+word_t artFrozenGet (artFrozen* f, byte_t* k, int l) {
+  byte_t *n = f->root, *q;
+  int i = 0, j;
+
+  for (;;) {
+    if (n[1] > l - i || memcmp(n + 2, k + i, n[1]))
+      return 0;
+    i += n[1];
+    if (i == l)
+      return artFrozenVal(n);
+    if (!(q = artFrozenKids(n)))
+      return 0;
+    j = artFrozenFind(q, k[i]);
+    if (j > q[0] || q[1 + j] != k[i])
+      return 0;
+    n = artFrozenChild(n, q, j);
+    i++;
+  }
+}
+
+/* the first off bytes of n's prefix are already in key */
+static int __artFrozenWalk (byte_t* n, int off, byte_t* key, int depth,
+                            artVisitor fn, void* ctx) {
+  byte_t* q;
+  word_t v;
+  int i;
+
+  memcpy(key + depth, n + 2 + off, n[1] - off);
+  depth += n[1] - off;
+  v = artFrozenVal(n);
+  if (v && fn(ctx, key, depth, v))
+    return 1;
+  if (!(q = artFrozenKids(n)))
+    return 0;
+  for (i = 0; i <= q[0]; i++) {
+    key[depth] = q[1 + i];
+    if (__artFrozenWalk(artFrozenChild(n, q, i), 0, key, depth + 1, fn, ctx))
+      return 1;
+  }
+  return 0;
+}
+
+void artFrozenScan (artFrozen* f, byte_t* p, int l, artVisitor fn, void* ctx) {
+  byte_t key[256];
+  byte_t *n = f->root, *q;
+  int d = 0, m, j;
+
+  if (l > 255) return;
+  for (;;) {
+    m = n[1] < l - d ? n[1] : l - d;
+    if (memcmp(n + 2, p + d, m))
+      return;
+    if (m == l - d) {
+      memcpy(key, p, d);
+      __artFrozenWalk(n, 0, key, d, fn, ctx);
+      return;
+    }
+    d += n[1];
+    if (!(q = artFrozenKids(n)))
+      return;
+    j = artFrozenFind(q, p[d]);
+    if (j > q[0] || q[1 + j] != p[d])
+      return;
+    n = artFrozenChild(n, q, j);
+    d++;
+  }
+}
+
+static void artFrozenPush (artFrozenCursor* c, byte_t* n, int len) {
+  artFrozenFrame* f = &c->stack[c->depth++];
+  memcpy(c->key + len, n + 2, n[1]);
+  f->node = n;
+  f->next = -1;
+  f->len = len + n[1];
+}
+
+/* next is -1 while the node's value is due, then the index of the
+ * next child */
+void artFrozenSeek (artFrozen* fz, artFrozenCursor* c, byte_t* k, int l) {
+  artFrozenFrame* f;
+  byte_t *n = fz->root, *q;
+  int d = 0, r, j;
+
+  c->frozen = fz;
+  c->depth = 0;
+  c->len = 0;
+  c->val = 0;
+  artFrozenPush(c, n, 0);
+  for (;;) {
+    f = &c->stack[c->depth - 1];
+    r = memcmp(c->key + d, k + d, n[1] < l - d ? n[1] : l - d);
+    if (r > 0 || (!r && n[1] > l - d))
+      return;
+    if (r < 0) {
+      f->next = 256;
+      return;
+    }
+    d += n[1];
+    if (d == l)
+      return;
+    if (!(q = artFrozenKids(n))) {
+      f->next = 256;
+      return;
+    }
+    j = artFrozenFind(q, k[d]);
+    f->next = j;
+    if (j > q[0] || q[1 + j] != k[d])
+      return;
+    f->next = j + 1;
+    n = artFrozenChild(n, q, j);
+    c->key[d] = k[d];
+    artFrozenPush(c, n, ++d);
+  }
+}
+
+int artFrozenNext (artFrozenCursor* c) {
+  artFrozenFrame* f;
+  byte_t* q;
+  int j;
+
+  while (c->depth) {
+    f = &c->stack[c->depth - 1];
+    if (f->next < 0) {
+      f->next = 0;
+      c->len = f->len;
+      if ((c->val = artFrozenVal(f->node)))
+        return 1;
+    }
+    q = artFrozenKids(f->node);
+    if (!q || f->next > q[0]) {
+      c->depth--;
+      continue;
+    }
+    j = f->next++;
+    c->key[f->len] = q[1 + j];
+    artFrozenPush(c, artFrozenChild(f->node, q, j), f->len + 1);
+  }
+  c->val = 0;
+  return 0;
+}
+
+int artFrozenSave (artFrozen* f, char* path) {
+  FILE* out = fopen(path, "wb");
+  int ok;
+  if (!out) return 0;
+  ok = fwrite(f->base, 1, f->size, out) == f->size;
+  return fclose(out) == 0 && ok;
+}
+
+artFrozen* artFrozenLoad (char* path) {
+  artFrozenHeader h;
+  artFrozen* f;
+  byte_t* base;
+  word_t size;
+
+  if (!(base = artMapFile(path, &size)))
+    return NULL;
+  if (size < sizeof(h) + 2) {
+    artUnmapFile(base, size);
+    return NULL;
+  }
+  memcpy(&h, base, sizeof(h));
+  if (h.magic != ART_FROZEN_MAGIC || h.word != sizeof(word_t) || h.size != size) {
+    artUnmapFile(base, size);
+    return NULL;
+  }
+  f = artMalloc(sizeof(artFrozen));
+  f->base = base;
+  f->root = base + sizeof(artFrozenHeader);
+  f->size = size;
+  f->count = h.count;
+#ifndef ART_NO_MMAP
+  f->mapped = 1;
+#endif
+  return f;
+}
+
+void artFrozenFree (artFrozen* f) {
+#ifndef ART_NO_MMAP
+  if (f->mapped) munmap(f->base, f->size);
+  else
+#endif
+  free(f->base);
+  free(f);
+}
+
+/* line loader
+ *   keys are put straight from the mapped file. memchr finds each line's
+ *   end and its first tab, and a carriage return before the newline is
+ *   dropped. */
+
+int artLoadLines (Art* art, char* path, artLineFn fn, void* ctx) {
+  byte_t *base, *p, *e, *t, *end;
+  word_t size, v, line = 0;
+  int n = 0, l, kl;
+
+  if (!(base = artMapFile(path, &size)))
+    return -1;
+#ifndef ART_NO_MMAP
+  posix_madvise(base, size, POSIX_MADV_SEQUENTIAL);
+#endif
+  for (p = base, end = base + size; p < end; p = e + 1) {
+    if (!(e = memchr(p, '\n', end - p))) e = end;
+    line++;
+    l = (int)(e - p);
+    if (l && p[l - 1] == '\r') l--;
+    t = memchr(p, '\t', l);
+    kl = t ? (int)(t - p) : l;
+    if (kl < 1 || kl > 255) continue;
+    v = fn ? fn(ctx, p, kl, p + kl + (t != NULL), l - kl - (t != NULL)) : line;
+    if (!v) continue;
+    artPut(art, p, kl, v);
+    n++;
+  }
+  artUnmapFile(base, size);
+  return n;
+}
+
+#ifndef ART_NO_THREADS
+/* parallel scans
+ *   a scan is cut into tasks at _SPAN, _INNER48 and _RADIX fan-out
+ *   points near the top of the tree. every worker owns a deque: it takes its own work
+ *   from the back, depth first, and steals from the front of the others,
+ *   where the largest subtrees sit, so skewed key spaces stay balanced.
+ *
+ *   ordered scans cut a fixed frontier of tasks in key order instead.
+ *   workers buffer each task's keys and the calling thread hands them to
+ *   the visitor in sequence, so the visitor never runs concurrently. */
+
+#define ART_SPLIT_DEPTH 8
+#define ART_SPLIT_TASKS 16
+
+typedef struct {
+  artNode* n;
+  int      off;
+  int      depth;
+  int      seq;
+  word_t   val;
+  byte_t   key[256];
+} artTask;
+
+typedef struct {
+  artTask*        tasks;
+  int             head;
+  int             tail;
+  int             cap;
+  pthread_mutex_t lock;
+} artDeque;
+
+typedef struct {
+  byte_t* data;
+  size_t  len;
+  size_t  cap;
+  int     done;
+} artScanBuf;
+
+typedef struct {
+  Art*            art;
+  artVisitor      fn;
+  void*           ctx;
+  artDeque*       deques;
+  artScanBuf*     bufs;
+  int             nthreads;
+  int             ordered;
+  int             pending;
+  int             idle;
+  int             gen;
+  int             stop;
+  pthread_mutex_t lock;
+  pthread_cond_t  cond;
+} artPool;
+
+typedef struct {
+  artPool* pool;
+  int      id;
+} artWorker;
+
+static void artDequePush (artDeque* q, artTask* t) {
+  pthread_mutex_lock(&q->lock);
+  if (q->tail == q->cap && q->head > 0) {
+    memmove(q->tasks, q->tasks + q->head, (q->tail - q->head) * sizeof(artTask));
+    q->tail -= q->head;
+    q->head = 0;
+  }
+  if (q->tail == q->cap) {
+    q->cap = q->cap ? q->cap * 2 : 64;
+    q->tasks = realloc(q->tasks, q->cap * sizeof(artTask));
+    if (!q->tasks) {
+      fprintf(stderr, "Fatal: out of memory.");
+      abort();
+    }
+  }
+  q->tasks[q->tail++] = *t;
+  pthread_mutex_unlock(&q->lock);
+}
+
+static int artDequeTake (artDeque* q, artTask* t, int front) {
+  int r = 0;
+  pthread_mutex_lock(&q->lock);
+  if (q->head < q->tail) {
+    *t = front ? q->tasks[q->head++] : q->tasks[--q->tail];
+    r = 1;
+  }
+  pthread_mutex_unlock(&q->lock);
+  return r;
+}
+
+static void artPoolStop (artPool* pool) {
+  pthread_mutex_lock(&pool->lock);
+  pool->stop = 1;
+  pthread_cond_broadcast(&pool->cond);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+static int artScanBufVisitor (void* ctx, byte_t* k, int l, word_t v) {
+  artScanBuf* b = (artScanBuf *)ctx;
+  size_t need = 1 + l + sizeof(word_t);
+  if (b->len + need > b->cap) {
+    b->cap = (b->cap + need) * 2;
+    b->data = realloc(b->data, b->cap);
+    if (!b->data) {
+      fprintf(stderr, "Fatal: out of memory.");
+      abort();
+    }
+  }
+  b->data[b->len] = (byte_t)l;
+  memcpy(b->data + b->len + 1, k, l);
+  memcpy(b->data + b->len + 1 + l, &v, sizeof(word_t));
+  b->len += need;
+  return 0;
+}
+
+/* runs one task. unordered scans split fan-out nodes into more tasks */
+static int artScanRun (artPool* pool, artWorker* w, artTask* t) {
+  byte_t keys[256];
+  artNode* kids[256];
+  artTask c;
+  artVisitor fn = pool->fn;
+  void* ctx = pool->ctx;
+  int i, n, type;
+
+  if (pool->ordered) {
+    fn = artScanBufVisitor;
+    ctx = &pool->bufs[t->seq];
+  }
+  if (!t->n)
+    return fn(ctx, t->key, t->depth, t->val);
+
+  /* stop splitting once there is enough queued work to steal */
+  pthread_mutex_lock(&pool->lock);
+  i = pool->pending;
+  pthread_mutex_unlock(&pool->lock);
+  type = t->n->head.type;
+  if (pool->ordered || t->depth >= ART_SPLIT_DEPTH
+    || i > pool->nthreads * ART_SPLIT_TASKS
+    || (type != _SPAN && type != _INNER48 && type != _RADIX && t->seq != 0))
+    return __artWalk(pool->art, t->n, t->off, t->key, t->depth, fn, ctx);
+
+  memcpy(t->key + t->depth, artNodeGetPrefix(t->n) + t->off,
+    t->n->head.plen - t->off);
+  t->depth += t->n->head.plen - t->off;
+  t->val = artNodeGetVal(t->n);
+  if (t->val && fn(ctx, t->key, t->depth, t->val))
+    return 1;
+
+  n = artNodeChildren(pool->art, t->n, keys, kids);
+  pthread_mutex_lock(&pool->lock);
+  pool->pending += n;
+  pthread_mutex_unlock(&pool->lock);
+  c.off = 0;
+  c.seq = -1;
+  c.depth = t->depth;
+  memcpy(c.key, t->key, t->depth);
+  for (i = n - 1; i >= 0; i--) {
+    c.n = kids[i];
+    artDequePush(&pool->deques[w->id], &c);
+  }
+  pthread_mutex_lock(&pool->lock);
+  pool->gen += 1;
+  if (pool->idle) pthread_cond_broadcast(&pool->cond);
+  pthread_mutex_unlock(&pool->lock);
+  return 0;
+}
+
+static void* artScanWorker (void* arg) {
+  artWorker* w = (artWorker *)arg;
+  artPool* pool = w->pool;
+  artTask t;
+  int i, gen, done, found;
+
+  for (;;) {
+    pthread_mutex_lock(&pool->lock);
+    gen = pool->gen;
+    done = pool->stop;
+    pthread_mutex_unlock(&pool->lock);
+    if (done) break;
+    found = artDequeTake(&pool->deques[w->id], &t, pool->ordered);
+    for (i = 1; !found && i < pool->nthreads; i++)
+      found = artDequeTake(&pool->deques[(w->id + i) % pool->nthreads], &t, 1);
+    if (!found) {
+      /* sleep until a task is pushed or the last one finishes */
+      pthread_mutex_lock(&pool->lock);
+      done = !pool->pending || pool->stop;
+      if (!done && gen == pool->gen) {
+        pool->idle += 1;
+        pthread_cond_wait(&pool->cond, &pool->lock);
+        pool->idle -= 1;
+      }
+      pthread_mutex_unlock(&pool->lock);
+      if (done) break;
+      continue;
+    }
+    if (artScanRun(pool, w, &t))
+      artPoolStop(pool);
+    pthread_mutex_lock(&pool->lock);
+    pool->pending -= 1;
+    if (t.seq >= 0 && pool->ordered)
+      pool->bufs[t.seq].done = 1;
+    if ((t.seq >= 0 && pool->ordered) || !pool->pending)
+      pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+  }
+  return NULL;
+}
+
+/* cuts the scan into at least want tasks in key order. values held by
+ * expanded nodes become tasks of their own so their order is kept. */
+static int artScanFrontier (Art* art, artTask* root, artTask** out, int want) {
+  byte_t keys[256];
+  artNode* kids[256];
+  artTask *cur, *next, *t;
+  int i, j, c, n = 1, m, grown = 1;
+
+  cur = artMalloc(sizeof(artTask));
+  cur[0] = *root;
+  while (n < want && grown) {
+    for (i = 0, m = 0; i < n; i++) {
+      c = cur[i].n ? artNodeChildren(art, cur[i].n, keys, kids) : 0;
+      m += c && cur[i].depth < ART_SPLIT_DEPTH ? c + 1 : 1;
+    }
+    next = artMalloc(sizeof(artTask) * m);
+    grown = 0;
+    for (i = 0, m = 0; i < n; i++) {
+      t = &cur[i];
+      c = t->n ? artNodeChildren(art, t->n, keys, kids) : 0;
+      if (!c || t->depth >= ART_SPLIT_DEPTH) {
+        next[m++] = *t;
+        continue;
+      }
+      grown = 1;
+      memcpy(t->key + t->depth, artNodeGetPrefix(t->n) + t->off,
+        t->n->head.plen - t->off);
+      t->depth += t->n->head.plen - t->off;
+      t->val = artNodeGetVal(t->n);
+      if (t->val) {
+        next[m] = *t;
+        next[m++].n = NULL;
+      }
+      for (j = 0; j < c; j++) {
+        next[m] = *t;
+        next[m].n = kids[j];
+        next[m++].off = 0;
+      }
+    }
+    free(cur);
+    cur = next;
+    n = m;
+  }
+  for (i = 0; i < n; i++)
+    cur[i].seq = i;
+  *out = cur;
+  return n;
+}
+
+void artScanParallel (Art* art, byte_t* p, int l, artVisitor fn, void* ctx,
+                      int nthreads, int ordered) {
+  pthread_t* threads;
+  artWorker* workers;
+  artTask root, *tasks = NULL;
+  artPool pool;
+  artScanBuf* b;
+  byte_t* e;
+  word_t v;
+  int i, j, n, stop = 0;
+
+  if (nthreads < 2) {
+    artScan(art, p, l, fn, ctx);
+    return;
+  }
+  artFlush(art);
+
+  root.n = artGetNode(art, p, l, &root.depth);
+  if (!root.n) return;
+  memcpy(root.key, p, root.depth);
+  root.off = 0;
+  root.seq = 0;
+  root.val = 0;
+
+  memset(&pool, 0, sizeof(pool));
+  pool.art = art;
+  pool.fn = fn;
+  pool.ctx = ctx;
+  pool.nthreads = nthreads;
+  pool.ordered = ordered;
+  pool.deques = artMalloc(sizeof(artDeque) * nthreads);
+  pthread_mutex_init(&pool.lock, NULL);
+  pthread_cond_init(&pool.cond, NULL);
+  for (i = 0; i < nthreads; i++)
+    pthread_mutex_init(&pool.deques[i].lock, NULL);
+
+  if (ordered) {
+    n = artScanFrontier(art, &root, &tasks, nthreads * ART_SPLIT_TASKS);
+    pool.bufs = artMalloc(sizeof(artScanBuf) * n);
+    pool.pending = n;
+    for (i = 0; i < n; i++)
+      artDequePush(&pool.deques[i % nthreads], &tasks[i]);
+    free(tasks);
+  } else {
+    pool.pending = 1;
+    artDequePush(&pool.deques[0], &root);
+  }
+
+  /* ordered scans keep the caller free to feed the visitor */
+  j = ordered ? nthreads : nthreads - 1;
+  threads = artMalloc(sizeof(pthread_t) * nthreads);
+  workers = artMalloc(sizeof(artWorker) * nthreads);
+  for (i = 0; i < nthreads; i++) {
+    workers[i].pool = &pool;
+    workers[i].id = i;
+  }
+  /* workers that fail to start leave their queues to the others */
+  for (i = 0; i < j && !pthread_create(&threads[i], NULL, artScanWorker, &workers[i]); i++);
+  j = i;
+  if (ordered && !j) artScanWorker(&workers[0]);
+
+  if (!ordered) {
+    artScanWorker(&workers[nthreads - 1]);
+  } else {
+    for (i = 0; i < n; i++) {
+      b = &pool.bufs[i];
+      pthread_mutex_lock(&pool.lock);
+      while (!b->done && !pool.stop)
+        pthread_cond_wait(&pool.cond, &pool.lock);
+      pthread_mutex_unlock(&pool.lock);
+      for (e = b->data; !stop && e < b->data + b->len; e += 1 + e[0] + sizeof(word_t)) {
+        memcpy(&v, e + 1 + e[0], sizeof(word_t));
+        stop = fn(ctx, e + 1, e[0], v);
+      }
+      free(b->data);
+      b->data = NULL;
+      if (stop) {
+        artPoolStop(&pool);
+        break;
+      }
+    }
+  }
+
+  for (i = 0; i < j; i++)
+    pthread_join(threads[i], NULL);
+  if (ordered) {
+    for (i = 0; i < n; i++)
+      free(pool.bufs[i].data);
+    free(pool.bufs);
+  }
+  for (i = 0; i < nthreads; i++) {
+    pthread_mutex_destroy(&pool.deques[i].lock);
+    free(pool.deques[i].tasks);
+  }
+  pthread_mutex_destroy(&pool.lock);
+  pthread_cond_destroy(&pool.cond);
+  free(pool.deques);
+  free(threads);
+  free(workers);
+}
+
+/* parallel construction
+ *   keys are bucketed on the first byte past their common prefix. each
+ *   bucket is built into a private tree by whichever worker claims it,
+ *   largest first, and its top node is then moved below a fan-out node
+ *   that holds the common prefix. compact trees share one chunk table,
+ *   so references made by any worker stay valid in the result. */
+
+#define ART_BUILD_MIN 4096
+
+typedef struct {
+  Art*            art;
+  byte_t**        keys;
+  int*            lens;
+  word_t*         vals;
+  int*            order;
+  int*            start;
+  byte_t*         buckets;
+  int             nbuckets;
+  int             next;
+  int             lcp;
+  artNode*        tops[256];
+  word_t          used[256];
+  pthread_mutex_t lock;
+} artBuild;
+
+static void* artBuildWorker (void* arg) {
+  artBuild* b = arg;
+  Art* sub;
+  int i, c;
+  for (;;) {
+    pthread_mutex_lock(&b->lock);
+    i = b->next++;
+    pthread_mutex_unlock(&b->lock);
+    if (i >= b->nbuckets) break;
+    c = b->buckets[i];
+    sub = artMalloc(sizeof(Art));
+    sub->flags = ART_PRIVATE;
+#ifdef ART_COMPACT
+    sub->arena = artArenaNew(b->art->arena->table);
+#endif
+    sub->root = artNodeAlloc(sub, _SINGLE);
+    for (i = b->start[c]; i < b->start[c + 1]; i++)
+      __artPut(sub, b->keys[b->order[i]], b->lens[b->order[i]], b->vals[b->order[i]]);
+    /* the bucket's keys share lcp + 1 bytes, so the root has one child */
+    b->tops[c] = artNodeGetChild(sub, sub->root, (byte_t)(b->lcp ? b->keys[b->order[b->start[c]]][0] : c));
+    artNodeMovePrefix(b->tops[c], b->lcp);
+    artNodeFree(sub, sub->root);
+    b->used[c] = sub->bytes;
+#ifdef ART_COMPACT
+    free(sub->arena);
+#endif
+    free(sub);
+  }
+  return NULL;
+}
+
+Art* artBuildParallel (byte_t** keys, int* lens, word_t* vals, int n, int nthreads) {
+  Art* art = artNew();
+  artNode *f;
+  artBuild b;
+  pthread_t* threads;
+  int cnt[257], i, j, c, first = -1, top = -1;
+  word_t total = 0;
+
+  memset(&b, 0, sizeof(b));
+  b.lcp = 256;
+  for (i = 0; i < n; i++) {
+    if (lens[i] < 1 || lens[i] > 255) continue;
+    if (first < 0) {
+      first = i;
+      b.lcp = lens[i];
+      continue;
+    }
+    if (lens[i] < b.lcp) b.lcp = lens[i];
+    for (j = 0; j < b.lcp && keys[i][j] == keys[first][j]; j++);
+    b.lcp = j;
+  }
+  if (first < 0) return art;
+  if (nthreads < 2 || n < ART_BUILD_MIN) {
+    for (i = 0; i < n; i++)
+      __artPut(art, keys[i], lens[i], vals[i]);
+    return art;
+  }
+
+  memset(cnt, 0, sizeof(cnt));
+  for (i = 0; i < n; i++) {
+    if (lens[i] < 1 || lens[i] > 255) continue;
+    if (lens[i] == b.lcp) top = i;
+    else cnt[keys[i][b.lcp]]++;
+  }
+  b.start = artMalloc(sizeof(int) * 257);
+  for (c = 0; c < 256; c++)
+    b.start[c + 1] = b.start[c] + cnt[c];
+  memcpy(cnt, b.start, sizeof(int) * 256);
+  b.order = artMalloc(sizeof(int) * (b.start[256] + 1));
+  for (i = 0; i < n; i++)
+    if (lens[i] <= 255 && lens[i] > b.lcp)
+      b.order[cnt[keys[i][b.lcp]]++] = i;
+
+  /* largest buckets are claimed first so no worker is left with a long
+   * tail. the list is short enough for an insertion sort. */
+  b.buckets = artMalloc(256);
+  for (c = 0; c < 256; c++) {
+    if (b.start[c + 1] == b.start[c]) continue;
+    for (j = b.nbuckets++; j > 0; j--) {
+      i = b.buckets[j - 1];
+      if (b.start[i + 1] - b.start[i] >= b.start[c + 1] - b.start[c]) break;
+      b.buckets[j] = b.buckets[j - 1];
+    }
+    b.buckets[j] = (byte_t)c;
+  }
+
+  b.art = art;
+  b.keys = keys;
+  b.lens = lens;
+  b.vals = vals;
+  pthread_mutex_init(&b.lock, NULL);
+  if (nthreads > b.nbuckets) nthreads = b.nbuckets ? b.nbuckets : 1;
+  threads = artMalloc(sizeof(pthread_t) * nthreads);
+  /* the calling thread takes buckets too, so a worker that fails to
+   * start only leaves more for the rest */
+  for (j = 0; j < nthreads - 1 && !pthread_create(&threads[j], NULL, artBuildWorker, &b); j++);
+  artBuildWorker(&b);
+  for (i = 0; i < j; i++)
+    pthread_join(threads[i], NULL);
+  pthread_mutex_destroy(&b.lock);
+
+  /* the fan-out node is the root itself when there is no common prefix */
+  f = b.lcp ? artNodeAlloc(art, _SINGLE) : art->root;
+  artNodeSetPrefix(f, keys[first], b.lcp);
+  for (c = 0; c < 256; c++) {
+    if (!b.tops[c]) continue;
+    artNodeAddChild(art, &f, b.tops[c], (byte_t)c);
+    total += b.used[c];
+  }
+  if (top >= 0)
+    artNodeSetVal(art, &f, vals[top]);
+  if (b.lcp) artNodeAddChild(art, &art->root, f, keys[first][0]);
+  else art->root = f;
+  art->bytes += total;
+  bytes += total;
+
+  free(threads);
+  free(b.start);
+  free(b.order);
+  free(b.buckets);
+  return art;
 }
+#endif
 
 /* testing */
 void artNodePrintDetails (artNode* n) {
@@ -1083,7 +4279,7 @@ void artNodePrintDetails (artNode* n) {
       p = (artNodeSingle *)n;
       printf("Value: \"%s\"\n", (char *)p->val);
       printf("Children: | ");
-      printf("0x%lx | ", p->radix);
+      printf("0x%lx | ", (word_t)p->radix);
     break;
     case _INNER:
     case _LINEAR:
@@ -1092,36 +4288,40 @@ void artNodePrintDetails (artNode* n) {
         printf("Value: \"%s\"\n", (char *)l->val);
       printf("Children: | ");
       for (i = 0; i < _LINEAR; i++)
-        printf("0x%lx | ", l->radix[i]);
+        printf("0x%lx | ", (word_t)l->radix[i]);
     break;
     case _LINEAR16:
+    case _INNER16:
       l16 = (artNodeLinear16 *)n;
-      printf("Value: \"%s\"\n", (char *)l16->val);
+      if (type != _INNER16)
+        printf("Value: \"%s\"\n", (char *)l16->val);
       printf("Map: | ");
       for (i = 0; i < _LINEAR16; i++)
         printf("%c | ", l16->map[i]);
       printf("\n");
       printf("Children: | ");
       for (i = 0; i < _LINEAR16; i++)
-        printf("0x%lx | ", l16->radix[i]);
+        printf("0x%lx | ", (word_t)l16->radix[i]);
     break;
     case _SPAN:
+    case _INNER48:
       s = (artNodeSpan *)n;
-      printf("Value: \"%s\"\n", (char *)s->val);
+      if (type != _INNER48)
+        printf("Value: \"%s\"\n", (char *)s->val);
       printf("Map: | ");
       for (i = 0; i < 256; i++)
-        if (s->map[i] != 48) printf("%c : %d | ", i, s->map[i]);
+        if (artSpanHas(s, i)) printf("%c | ", i);
       printf("\n");
       printf("Children: | ");
       for (i = 0; i < 48; i++)
-        printf("0x%lx | ", s->radix[i]);
+        printf("0x%lx | ", (word_t)s->radix[i]);
     break;
     case _RADIX:
       r = (artNodeRadix *)n;
       printf("Value: \"%s\"\n", (char *)r->val);
       printf("Children: | ");
       for (i = 0; i < 256; i++)
-        printf("0x%lx | ", r->radix[i]);
+        printf("0x%lx | ", (word_t)r->radix[i]);
     break;
     default: break;
   }
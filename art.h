@@ -12,14 +12,36 @@
 typedef unsigned char byte_t;
 typedef unsigned long word_t;
 
+/* child references
+ *   by default a child slot holds the child's address. building with
+ *   ART_COMPACT places nodes in a tree-owned arena and stores 32 bit
+ *   references instead: the upper bits select a 1MB chunk and the lower
+ *   bits an 8 byte unit inside it, which reaches 32GB of nodes. */
+#ifdef ART_COMPACT
+typedef unsigned int artRef;
+#else
+typedef word_t artRef;
+#endif
+
+/* node types. the inner types are the layout before them without the
+ * value slot, for nodes that only route. */
 #define _LEAF     0
 #define _SINGLE   1
 #define _LINEAR   4
 #define _INNER    5
 #define _LINEAR16 16
+#define _INNER16  17
 #define _SPAN     48
+#define _INNER48  49
 #define _RADIX    255
 
+/* tree flags */
+#define ART_MULTI  1
+#define ART_SCORED 2
+#define ART_FIXED  4
+#define ART_CACHE  8
+#define ART_MERKLE 16
+
 typedef struct {
   byte_t type; 
   byte_t plen; 
@@ -37,8 +59,86 @@ typedef struct {
   artNodeHeader head;
 } artNode;
 
+#ifdef ART_COMPACT
+typedef struct artArena artArena;
+#endif
+
+typedef struct {
+  int    cnt;
+  int    cap;
+  word_t vals[1];
+} artPosting;
+
+/* keys waiting for artMaintenance, in a list of fixed size blocks so a
+ * growing queue never copies */
+typedef struct {
+  void*  head;
+  void*  tail;
+  int    pos;
+  int    cnt;
+} artQueue;
+
+/* maps a value to its score in ART_SCORED trees */
+typedef word_t (*artScoreFn) (word_t);
+
+/* told of every key an ART_CACHE tree evicts, with its value */
+typedef void (*artEvictFn) (void*, byte_t*, int, word_t);
+
+/* order-preserving key transcoder. encode and decode return the output
+ * length, or -1 for input outside the codec's alphabet. prefix encodes
+ * a raw key prefix into the bytes every key under it starts with. */
+typedef struct {
+  int (*encode) (byte_t*, int, byte_t*);
+  int (*decode) (byte_t*, int, byte_t*);
+  int (*prefix) (byte_t*, int, byte_t*);
+} artCodec;
+
+/* the value to put for a loaded line's key, given the key and the text
+ * after its first tab, which is empty when the line has none */
+typedef word_t (*artLineFn) (void*, byte_t*, int, byte_t*, int);
+
+typedef struct artBuffer artBuffer;
+typedef struct artFeed artFeed;
+typedef struct artCache artCache;
+
+typedef struct {
+  unsigned int* blocks;
+  word_t        mask;
+  word_t        cap;
+  word_t        keys;
+  word_t        removed;
+} artFilter;
+
+#define ART_FEED_PUT    1
+#define ART_FEED_REMOVE 2
+
+/* one change as a feed reader receives it */
+typedef struct {
+  word_t seq;
+  word_t val;
+  int    op;
+  int    len;
+  byte_t key[256];
+} artChange;
+
+/* ext bytes of per-node data sit in front of every node of the tree */
 typedef struct {
-  artNode* root;
+  artNode*   root;
+  int        flags;
+  int        ext;
+  word_t     bytes;
+  artScoreFn score;
+  artQueue*  lazy;
+  artCodec*  codec;
+  int        klen;
+  artBuffer* buffer;
+  artFilter* filter;
+  artFeed*   feed;
+  artCache*  cache;
+  word_t     version;
+#ifdef ART_COMPACT
+  artArena*  arena;
+#endif
 } Art;
 
 typedef struct {
@@ -49,48 +149,287 @@ typedef struct {
 typedef struct {
   artNodeHeader  head;
   byte_t         map;
-  word_t         radix;
+  artRef         radix;
   word_t         val;
 } artNodeSingle;
 
 typedef struct {
   artNodeHeader  head;
   byte_t         map[_LINEAR];
-  word_t         radix[_LINEAR];
+  artRef         radix[_LINEAR];
 } artNodeInner;
 
 typedef struct {
   artNodeHeader  head;
   byte_t         map[_LINEAR];
-  word_t         radix[_LINEAR];
+  artRef         radix[_LINEAR];
   word_t         val;
 } artNodeLinear;
 
 typedef struct {
   artNodeHeader  head;
   byte_t         map[_LINEAR16];
-  word_t         radix[_LINEAR16];
+  artRef         radix[_LINEAR16];
   word_t         val;
 } artNodeLinear16;
 
 typedef struct {
   artNodeHeader  head;
-  byte_t         map[256];
-  word_t         radix[_SPAN];
+  byte_t         map[_LINEAR16];
+  artRef         radix[_LINEAR16];
+} artNodeInner16;
+
+/* span nodes mark the key bytes they hold in a 256 bit map and pack
+ * their children in key order. a child's slot is the number of marked
+ * bytes below its own. */
+#define ART_SPAN_WORDS (256 / (8 * sizeof(word_t)))
+
+typedef struct {
+  artNodeHeader  head;
+  word_t         bits[ART_SPAN_WORDS];
+  artRef         radix[_SPAN];
   word_t         val;
 } artNodeSpan;
 
+typedef struct {
+  artNodeHeader  head;
+  word_t         bits[ART_SPAN_WORDS];
+  artRef         radix[_SPAN];
+} artNodeInner48;
+
 typedef struct {
   artNodeHeader  head;
   word_t         val;
-  word_t         radix[256];
+  artRef         radix[256];
 } artNodeRadix;
 
+/* cursor state. a frame per node on the path to the current key. */
+typedef struct {
+  artNode* node;
+  int      next;
+  int      len;
+} artCursorFrame;
+
+typedef struct {
+  Art*           art;
+  int            depth;
+  int            len;
+  word_t         val;
+  byte_t         key[256];
+  artCursorFrame stack[256];
+} artCursor;
+
+typedef struct {
+  artNode* node;
+  int      off;
+} artFingerFrame;
+
+typedef struct {
+  Art*           art;
+  word_t         version;
+  int            depth;
+  int            len;
+  byte_t         key[256];
+  artFingerFrame stack[256];
+} artFinger;
+
+/* a frozen tree is one read-only block of nodes, in memory or mapped
+ * from a file */
+typedef struct {
+  byte_t* base;
+  byte_t* root;
+  word_t  size;
+  word_t  count;
+  int     mapped;
+} artFrozen;
+
+typedef struct {
+  byte_t* node;
+  int     next;
+  int     len;
+} artFrozenFrame;
+
+typedef struct {
+  artFrozen*     frozen;
+  int            depth;
+  int            len;
+  word_t         val;
+  byte_t         key[256];
+  artFrozenFrame stack[256];
+} artFrozenCursor;
+
+/* visitors receive each key, its length and its value. returning
+ * non-zero stops the traversal. keys are only valid during the call. */
+typedef int (*artVisitor)     (void*, byte_t*, int, word_t);
+typedef int (*artJoinVisitor) (void*, byte_t*, int, word_t, word_t);
+
 /* API */
 void      artPut                   (Art*, byte_t*, int, word_t);
 word_t    artGet                   (Art*, byte_t*, int);
 int       artRemove                (Art*, byte_t*, int);
 Art*      artNew                   (void);
+void      artFree                  (Art*);
 artVal*   artGetWithPrefix         (Art*, byte_t*, int);
+void      artScan                  (Art*, byte_t*, int, artVisitor, void*);
+
+/* private trees keep their node bytes out of the global count, so trees
+ * under separate locks may be written from different threads. */
+Art*      artNewPrivate            (void);
+
+/* artExchange puts the value and returns the one it replaced, 0 if the
+ * key is new. artFree releases a tree and the postings of a multi-value
+ * tree; other values belong to the caller. */
+word_t    artExchange              (Art*, byte_t*, int, word_t);
+
+/* cursors walk keys in order without a callback. artCursorSeek places
+ * the cursor before the first key not less than k, and artCursorNext
+ * moves to the next key, leaving it in key, len and val, or returns 0
+ * past the last. the tree must not change while a cursor is in use. */
+void      artCursorSeek            (Art*, artCursor*, byte_t*, int);
+int       artCursorNext            (artCursor*);
+
+/* fingers remember the path of the last key they put or got and start
+ * the next descent at the deepest node both keys share, for keys that
+ * arrive sorted or in time order. any other change to the tree's nodes
+ * sends a finger back to the root. zero a finger before its first use,
+ * and use it with one tree at a time. */
+void      artPutFinger             (Art*, artFinger*, byte_t*, int, word_t);
+word_t    artGetFinger             (Art*, artFinger*, byte_t*, int);
+
+/* artRemoveLazy clears the value in place, at the cost of a lookup, and
+ * queues the node shrinking and merging. artMaintenance does at most
+ * budget queued keys and returns how many remain. it needs the same
+ * exclusion as any other write. */
+int       artRemoveLazy            (Art*, byte_t*, int);
+int       artMaintenance           (Art*, int);
+
+/* transcoders apply to put, get, remove and scans, and must be set while
+ * the tree is empty. other calls, cursors included, see the encoded
+ * keys. uuid packs the 36 byte form into 16 bytes, hex even length
+ * lowercase hex, alpha a-z in 5 bits a letter, and decimal sorts
+ * canonical numbers numerically. */
+extern artCodec artCodecUUID;
+extern artCodec artCodecHex;
+extern artCodec artCodecAlpha;
+extern artCodec artCodecDecimal;
+void      artSetCodec              (Art*, artCodec*);
+
+/* fixed trees hold keys of exactly len bytes, after any codec, and
+ * ignore others. no key prefixes another, so only leaves carry values
+ * and lookups skip the end of key tests on the way down. */
+Art*      artNewFixed              (int);
+
+/* a write buffer of n keys absorbs puts and removes, lazy ones too, and
+ * merges them into the tree in key order when it fills or on artFlush.
+ * gets see buffered writes; scans, cursors and the other readers flush
+ * first. n 0 flushes and drops the buffer. multi trees ignore it. */
+void      artSetBuffer             (Art*, int);
+void      artFlush                 (Art*);
+
+/* a bloom filter over the keys lets gets and removes of absent keys
+ * return after one cache line instead of a descent. artSetFilter with
+ * on set builds it from the tree, and with on clear drops it. puts keep
+ * it current. removals leave it stale; artFilterRebuild rebuilds it,
+ * in time linear in the tree, once they or new keys have made it too
+ * full, and returns whether it did. */
+void      artSetFilter             (Art*, int);
+int       artFilterRebuild         (Art*);
+
+/* a change feed keeps the last n puts and removes made to the tree,
+ * lazy ones and buffer flushes included, with their encoded keys.
+ * a reader takes artFeedSeq, copies the tree by any means, and then
+ * calls artFeedRead from that sequence, which fills up to max changes,
+ * advances it and returns how many. -1 means changes were dropped
+ * before they were read and the copy must be taken again. artFeedApply
+ * replays changes on a tree with the same codec and flags. the feed
+ * shares the tree's locking. multi trees ignore it. */
+void      artSetFeed               (Art*, int);
+word_t    artFeedSeq               (Art*);
+int       artFeedRead              (Art*, word_t*, artChange*, int);
+void      artFeedApply             (Art*, artChange*, int);
+
+/* value of the longest stored key that prefixes k, 0 if none. the
+ * length of that key goes to the last argument when it is not NULL. */
+word_t    artLongestPrefix         (Art*, byte_t*, int, int*);
+
+/* multi-value trees: every key maps to an artPosting of sorted values.
+ * artPut behaves as artAdd, and artGet and prefix scans return the
+ * posting of a key. all of them take keys before any codec. */
+Art*      artNewMulti              (void);
+int       artAdd                   (Art*, byte_t*, int, word_t);
+int       artRemoveValue           (Art*, byte_t*, int, word_t);
+word_t*   artGetValues             (Art*, byte_t*, int, int*);
+
+/* scored trees cache the best score below every node. artTopK fills out
+ * with up to k keys under the prefix, best first, and returns how many.
+ * keys are malloc'd and NUL terminated. a NULL score function uses the
+ * values themselves as scores. */
+Art*      artNewScored             (artScoreFn);
+int       artTopK                  (Art*, byte_t*, int, int, artVal*);
+
+/* cache trees keep their node bytes, counted as in art->bytes, within
+ * budget. gets mark keys as referenced, and puts that go over budget
+ * sweep a CLOCK hand through the keys, evicting unreferenced ones and
+ * passing them, encoded, to the callback. long prefixes held outside
+ * the nodes are not counted. */
+Art*      artNewCache              (word_t, artEvictFn, void*);
+
+/* merkle trees keep a hash of the keys and values below every node,
+ * which writes update along their path. trees holding the same keys
+ * and values have the same root hash, whatever order they were written
+ * in. artDiff reports, in key order, every key whose value differs
+ * between a and b, with 0 for the side that lacks it, and skips the
+ * subtrees whose hashes agree when both trees are merkle trees. */
+Art*      artNewMerkle             (void);
+word_t    artRootHash              (Art*);
+void      artDiff                  (Art*, Art*, artJoinVisitor, void*);
+
+/* visits, in key order, every key within max insertions, deletions and
+ * substitutions of the query */
+void      artFuzzySearch           (Art*, byte_t*, int, int, artVisitor, void*);
+
+/* set operations, streamed in key order. artIntersect reports keys held
+ * by both trees with both values, artDifference keys of a missing in b. */
+void      artIntersect             (Art*, Art*, artJoinVisitor, void*);
+void      artDifference            (Art*, Art*, artVisitor, void*);
+
+/* re-tightens nodes after heavy removals and returns the bytes freed.
+ * artOptimizeStep does one root child per call; start *pos at 0 and
+ * call until it reaches 256. */
+word_t    artOptimize              (Art*);
+word_t    artOptimizeStep          (Art*, int*);
+
+/* artFreeze packs a tree into one read-only block: nodes in depth first
+ * order with inline prefixes, sorted child keys and child offsets
+ * relative to the parent, so the block can be saved and mapped back at
+ * any address. keys are as stored, after any codec. any number of
+ * threads can read a frozen tree without locks. multi trees, whose
+ * values point at postings, are not frozen and give NULL. artFrozenLoad
+ * trusts the file past its header; build with ART_NO_MMAP to read it
+ * into memory instead of mapping it. */
+artFrozen* artFreeze               (Art*);
+word_t    artFrozenGet             (artFrozen*, byte_t*, int);
+void      artFrozenScan            (artFrozen*, byte_t*, int, artVisitor, void*);
+void      artFrozenSeek            (artFrozen*, artFrozenCursor*, byte_t*, int);
+int       artFrozenNext            (artFrozenCursor*);
+int       artFrozenSave            (artFrozen*, char*);
+artFrozen* artFrozenLoad           (char*);
+void      artFrozenFree            (artFrozen*);
+
+/* artLoadLines puts a key for every line of a text file, read in place
+ * from a mapping of the file. a key runs to the line's first tab or its
+ * end, and takes the value fn returns, or its line number counted from
+ * 1 when fn is NULL. lines with empty or overlong keys, or a 0 value,
+ * are skipped. returns the keys put, or -1 if the file can't be read or
+ * is empty. */
+int       artLoadLines             (Art*, char*, artLineFn, void*);
+
+#ifndef ART_NO_THREADS
+/* prefix scan on nthreads threads. the tree must not change meanwhile.
+ * unordered scans call the visitor from every worker at once; ordered
+ * scans deliver keys in order on the calling thread. */
+void      artScanParallel          (Art*, byte_t*, int, artVisitor, void*, int, int);
+Art*      artBuildParallel         (byte_t**, int*, word_t*, int, int);
+#endif
 
 #endif
@@ -0,0 +1,432 @@
+/* C++ wrapper
+ *   art::map<Key, Value, KeyTraits> owns an Art and maps typed keys to
+ *   typed values. key traits encode keys to order-preserving bytes, and
+ *   values small enough for the tree's value word are stored in it.
+ *   needs C++17, and art.c built as C.
+ */
+
+#ifndef _ART_HPP
+#define _ART_HPP
+
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+extern "C" {
+#include "art.h"
+}
+
+namespace art {
+
+/* key traits
+ *   size is the encoded length of fixed length keys and 0 otherwise.
+ *   encode writes at most 255 bytes and returns the length, or -1 when
+ *   the key does not fit. decode may rewrite its input in place, and
+ *   views it returns point into that input. */
+template <class T, class = void>
+struct key_traits;
+
+namespace detail {
+
+template <class U, std::size_t... I>
+constexpr void store_be (U u, byte_t* out, std::index_sequence<I...>) {
+  ((out[I] = static_cast<byte_t>(u >> (8 * (sizeof(U) - 1 - I)))), ...);
+}
+
+template <class U, std::size_t... I>
+constexpr U load_be (const byte_t* in, std::index_sequence<I...>) {
+  return static_cast<U>((... | (static_cast<U>(in[I]) << (8 * (sizeof(U) - 1 - I)))));
+}
+
+}
+
+/* integers big-endian, with the sign bit flipped so negatives sort
+ * first. the byte moves are unrolled at compile time. */
+template <class T>
+struct key_traits<T, std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool>>> {
+  using U = std::make_unsigned_t<T>;
+  static constexpr int size = sizeof(T);
+  static constexpr U sign = std::is_signed_v<T> ? static_cast<U>(U(1) << (8 * sizeof(T) - 1)) : 0;
+
+  static constexpr int encode (T k, byte_t* out) {
+    detail::store_be<U>(static_cast<U>(k) ^ sign, out, std::make_index_sequence<sizeof(T)>());
+    return size;
+  }
+
+  static constexpr T decode (byte_t* in, int) {
+    return static_cast<T>(detail::load_be<U>(in, std::make_index_sequence<sizeof(T)>()) ^ sign);
+  }
+};
+
+/* strings as their bytes. the tree has no empty key. */
+template <>
+struct key_traits<std::string_view> {
+  static constexpr int size = 0;
+
+  static int encode (std::string_view k, byte_t* out) {
+    if (k.size() > 255) return -1;
+    std::memcpy(out, k.data(), k.size());
+    return static_cast<int>(k.size());
+  }
+
+  static std::string_view decode (byte_t* in, int l) {
+    return std::string_view(reinterpret_cast<const char*>(in), l);
+  }
+};
+
+template <>
+struct key_traits<std::string> {
+  static constexpr int size = 0;
+
+  static int encode (const std::string& k, byte_t* out) {
+    return key_traits<std::string_view>::encode(k, out);
+  }
+
+  static std::string decode (byte_t* in, int l) {
+    return std::string(reinterpret_cast<const char*>(in), l);
+  }
+};
+
+/* tuples concatenate their fields. variable length fields are made
+ * prefix-free by escaping 0 as 0 1 and ending with 0 0, which keeps
+ * field by field order. */
+template <class... Ts>
+struct key_traits<std::tuple<Ts...>> {
+  static constexpr int size = ((key_traits<Ts>::size > 0) && ...)
+    ? (key_traits<Ts>::size + ... + 0) : 0;
+
+  static int encode (const std::tuple<Ts...>& k, byte_t* out) {
+    int n = 0;
+    std::apply([&] (const Ts&... f) { ((n = n < 0 ? n : field(f, out, n)), ...); }, k);
+    return n;
+  }
+
+  static std::tuple<Ts...> decode (byte_t* in, int) {
+    int n = 0;
+    return std::tuple<Ts...>{ unfield<Ts>(in, n)... };
+  }
+
+private:
+  template <class T>
+  static int field (const T& f, byte_t* out, int n) {
+    byte_t tmp[256];
+    int i, l;
+    if constexpr (key_traits<T>::size > 0) {
+      if (n + key_traits<T>::size > 255) return -1;
+      return n + key_traits<T>::encode(f, out + n);
+    } else {
+      if ((l = key_traits<T>::encode(f, tmp)) < 0) return -1;
+      if (n + 2 > 255) return -1;
+      for (i = 0; i < l; i++) {
+        if (n + 3 + (tmp[i] == 0) > 255) return -1;
+        out[n++] = tmp[i];
+        if (!tmp[i]) out[n++] = 1;
+      }
+      out[n++] = 0;
+      out[n++] = 0;
+      return n;
+    }
+  }
+
+  /* braced initialization runs these left to right */
+  template <class T>
+  static T unfield (byte_t* in, int& n) {
+    int s = n, d = n;
+    if constexpr (key_traits<T>::size > 0) {
+      n += key_traits<T>::size;
+      return key_traits<T>::decode(in + s, key_traits<T>::size);
+    } else {
+      for (; in[n] || in[n + 1]; n++) {
+        in[d++] = in[n];
+        if (!in[n]) n++;
+      }
+      n += 2;
+      return key_traits<T>::decode(in + s, d - s);
+    }
+  }
+};
+
+/* value storage
+ *   trivially copyable values that fit the value word are kept in it.
+ *   the tree reserves 0 for absent, so narrower values get a marker bit
+ *   above them, and word sized values are xor'd with a constant whose
+ *   own bit pattern then cannot be stored. anything else is boxed. */
+template <class V>
+struct value_traits {
+  static constexpr bool direct = std::is_trivially_copyable_v<V> && sizeof(V) <= sizeof(word_t);
+  static constexpr word_t hole = (word_t(1) << (8 * sizeof(word_t) - 1)) | 1;
+
+  static word_t store (const V& v) {
+    if constexpr (!direct) {
+      return reinterpret_cast<word_t>(new V(v));
+    } else if constexpr (sizeof(V) < sizeof(word_t)) {
+      word_t w = 0;
+      std::memcpy(&w, &v, sizeof(V));
+      return w | word_t(1) << (8 * sizeof(V));
+    } else {
+      word_t w;
+      std::memcpy(&w, &v, sizeof(V));
+      if (w == hole) throw std::domain_error("art::map cannot store this value");
+      return w ^ hole;
+    }
+  }
+
+  static V load (word_t w) {
+    if constexpr (!direct) {
+      return *reinterpret_cast<V*>(w);
+    } else {
+      V v;
+      if (sizeof(V) == sizeof(word_t)) w ^= hole;
+      std::memcpy(&v, &w, sizeof(V));
+      return v;
+    }
+  }
+
+  static void release (word_t w) {
+    if constexpr (!direct) delete reinterpret_cast<V*>(w);
+  }
+};
+
+/* an ordered map over an adaptive radix tree. iterators are read-only
+ * and hold their element by value, so keys like string_view point into
+ * the iterator and live until it moves. any write invalidates every
+ * iterator. keys must encode to 1 to 255 bytes. */
+template <class Key, class Value, class KeyTraits = key_traits<Key>>
+class map {
+public:
+  using key_type = Key;
+  using mapped_type = Value;
+  using value_type = std::pair<Key, Value>;
+  using size_type = std::size_t;
+  using values = value_traits<Value>;
+
+  class const_iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = map::value_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const value_type*;
+    using reference = const value_type&;
+
+    const_iterator () {}
+
+    const_iterator (const const_iterator& o) {
+      if (o.cur_) {
+        cur_ = std::make_unique<artCursor>(*o.cur_);
+        load();
+      }
+    }
+
+    /* elements may point into buf_, so a moved iterator decodes again */
+    const_iterator (const_iterator&& o) : cur_(std::move(o.cur_)) {
+      o.elem_.reset();
+      if (cur_) load();
+    }
+
+    const_iterator& operator= (const const_iterator& o) {
+      if (this != &o) *this = const_iterator(o);
+      return *this;
+    }
+
+    const_iterator& operator= (const_iterator&& o) {
+      cur_ = std::move(o.cur_);
+      o.elem_.reset();
+      elem_.reset();
+      if (cur_) load();
+      return *this;
+    }
+
+    reference operator* () const { return *elem_; }
+    pointer operator-> () const { return &*elem_; }
+
+    const_iterator& operator++ () {
+      next();
+      return *this;
+    }
+
+    const_iterator operator++ (int) {
+      const_iterator t(*this);
+      next();
+      return t;
+    }
+
+    bool operator== (const const_iterator& o) const {
+      if (!cur_ || !o.cur_) return !cur_ && !o.cur_;
+      return cur_->len == o.cur_->len && !std::memcmp(cur_->key, o.cur_->key, cur_->len);
+    }
+
+    bool operator!= (const const_iterator& o) const { return !(*this == o); }
+
+  private:
+    friend class map;
+
+    const_iterator (Art* t, byte_t* k, int l) : cur_(new artCursor) {
+      artCursorSeek(t, cur_.get(), k, l);
+      next();
+    }
+
+    void next () {
+      if (artCursorNext(cur_.get())) load();
+      else cur_.reset(), elem_.reset();
+    }
+
+    void load () {
+      std::memcpy(buf_, cur_->key, cur_->len);
+      elem_.emplace(KeyTraits::decode(buf_, cur_->len), values::load(cur_->val));
+    }
+
+    std::unique_ptr<artCursor> cur_;
+    std::optional<value_type>  elem_;
+    byte_t                     buf_[256];
+  };
+
+  using iterator = const_iterator;
+
+  map () : art_(fresh()) {}
+
+  ~map () {
+    if (art_) {
+      drop();
+      artFree(art_);
+    }
+  }
+
+  map (map&& o) noexcept : art_(o.art_), size_(o.size_) {
+    o.art_ = nullptr;
+    o.size_ = 0;
+  }
+
+  map& operator= (map&& o) noexcept {
+    std::swap(art_, o.art_);
+    std::swap(size_, o.size_);
+    return *this;
+  }
+
+  map (const map&) = delete;
+  map& operator= (const map&) = delete;
+
+  size_type size () const { return size_; }
+  bool empty () const { return !size_; }
+
+  /* true when the key was new */
+  bool insert_or_assign (const Key& k, const Value& v) {
+    return with_key(k, [&] (byte_t* b, int l) {
+      word_t old = artExchange(art_, b, l, values::store(v));
+      if (old) values::release(old);
+      else size_++;
+      return !old;
+    });
+  }
+
+  /* leaves an existing value alone */
+  bool insert (const Key& k, const Value& v) {
+    return with_key(k, [&] (byte_t* b, int l) {
+      if (artGet(art_, b, l)) return false;
+      artPut(art_, b, l, values::store(v));
+      size_++;
+      return true;
+    });
+  }
+
+  std::optional<Value> get (const Key& k) const {
+    return with_key(k, [&] (byte_t* b, int l) {
+      word_t w = artGet(art_, b, l);
+      return w ? std::optional<Value>(values::load(w)) : std::nullopt;
+    });
+  }
+
+  Value at (const Key& k) const {
+    std::optional<Value> v = get(k);
+    if (!v) throw std::out_of_range("art::map::at");
+    return *v;
+  }
+
+  bool contains (const Key& k) const {
+    return with_key(k, [&] (byte_t* b, int l) { return artGet(art_, b, l) != 0; });
+  }
+
+  size_type count (const Key& k) const { return contains(k); }
+
+  size_type erase (const Key& k) {
+    return with_key(k, [&] (byte_t* b, int l) -> size_type {
+      word_t old = values::direct ? 0 : artGet(art_, b, l);
+      if (!artRemove(art_, b, l)) return 0;
+      values::release(old);
+      size_--;
+      return 1;
+    });
+  }
+
+  void clear () {
+    drop();
+    artFree(art_);
+    art_ = fresh();
+    size_ = 0;
+  }
+
+  const_iterator begin () const {
+    byte_t none = 0;
+    return const_iterator(art_, &none, 0);
+  }
+  const_iterator end () const { return const_iterator(); }
+
+  const_iterator lower_bound (const Key& k) const {
+    return with_key(k, [&] (byte_t* b, int l) { return const_iterator(art_, b, l); });
+  }
+
+  const_iterator find (const Key& k) const {
+    return with_key(k, [&] (byte_t* b, int l) {
+      const_iterator i(art_, b, l);
+      if (i.cur_ && (i.cur_->len != l || std::memcmp(i.cur_->key, b, l))) return end();
+      return i;
+    });
+  }
+
+  /* the underlying tree, for the C API */
+  Art* tree () const { return art_; }
+
+private:
+  /* fixed length keys get a fixed tree */
+  static Art* fresh () {
+    return KeyTraits::size > 0 ? artNewFixed(KeyTraits::size) : artNew();
+  }
+
+  template <class F>
+  decltype(auto) with_key (const Key& k, F f) const {
+    if constexpr (KeyTraits::size > 0) {
+      static_assert(KeyTraits::size <= 255, "art::map keys are at most 255 bytes");
+      byte_t b[KeyTraits::size];
+      KeyTraits::encode(k, b);
+      return f(b, KeyTraits::size);
+    } else {
+      byte_t b[256];
+      int l = KeyTraits::encode(k, b);
+      if (l < 0) throw std::length_error("art::map key longer than 255 bytes");
+      if (!l) throw std::invalid_argument("art::map key is empty");
+      return f(b, l);
+    }
+  }
+
+  /* boxed values are freed before the tree */
+  void drop () {
+    if constexpr (!values::direct) {
+      for (const_iterator i = begin(); i.cur_; i.next())
+        values::release(i.cur_->val);
+    }
+  }
+
+  Art*      art_;
+  size_type size_ = 0;
+};
+
+}
+
+#endif
@@ -0,0 +1,115 @@
+/* helpers shared by the ycsb and client drivers
+ *   a xorshift generator, a hash to scatter integers, a monotonic clock,
+ *   a latency histogram and a line reader for key files. everything is
+ *   static, so each driver gets its own copy. */
+
+#ifndef _ART_BENCH_H
+#define _ART_BENCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "art.h"
+
+/* log-linear buckets: exact below 16ns, then 8 per power of two */
+#define HIST_SUB     8
+#define HIST_BUCKETS (64 * HIST_SUB)
+
+typedef struct {
+  word_t count;
+  word_t total;
+  word_t max;
+  word_t buckets[HIST_BUCKETS];
+} histogram;
+
+static word_t nextRandom (word_t* s) {
+  word_t x = *s;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  *s = x;
+  return x;
+}
+
+static word_t fnv (word_t v) {
+  word_t h = 0xcbf29ce484222325UL;
+  int i;
+  for (i = 0; i < 8; i++) {
+    h ^= v & 0xff;
+    h *= 0x100000001b3UL;
+    v >>= 8;
+  }
+  return h;
+}
+
+static double wallClock (void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void histAdd (histogram* h, word_t ns) {
+  int b = 0, sub;
+  word_t v = ns;
+  while (v >= 2 * HIST_SUB) {
+    v >>= 1;
+    b++;
+  }
+  sub = (int)v;
+  if (b * HIST_SUB + sub >= HIST_BUCKETS) sub = HIST_BUCKETS - 1 - b * HIST_SUB;
+  h->buckets[b * HIST_SUB + sub]++;
+  h->count++;
+  h->total += ns;
+  if (ns > h->max) h->max = ns;
+}
+
+static void histMerge (histogram* into, histogram* h) {
+  int b;
+  into->count += h->count;
+  into->total += h->total;
+  if (h->max > into->max) into->max = h->max;
+  for (b = 0; b < HIST_BUCKETS; b++)
+    into->buckets[b] += h->buckets[b];
+}
+
+/* upper bound in ns of bucket i */
+static word_t histBound (int i) {
+  int b = i / HIST_SUB - 1;
+  if (i < 2 * HIST_SUB) return i + 1;
+  return (word_t)(i - b * HIST_SUB + 1) << b;
+}
+
+static word_t histPercentile (histogram* h, double p) {
+  word_t want = (word_t)(h->count * p), seen = 0;
+  int i;
+  for (i = 0; i < HIST_BUCKETS; i++) {
+    seen += h->buckets[i];
+    if (seen > want) return histBound(i);
+  }
+  return h->max;
+}
+
+/* the next line of f without its newline, NULL at the end */
+static byte_t* readLine (FILE* f, int* len) {
+  byte_t* buf = NULL;
+  int c, i = 0, cap = 0;
+  while ((c = fgetc(f)) != '\n') {
+    if (c == EOF) {
+      if (!i) {
+        free(buf);
+        return NULL;
+      }
+      break;
+    }
+    if (i + 1 >= cap) buf = realloc(buf, cap = cap ? cap * 2 : 32);
+    buf[i++] = (byte_t)c;
+  }
+  if (!buf) buf = malloc(1);
+  buf[i] = 0;
+  *len = i;
+  return buf;
+}
+
+#endif
@@ -0,0 +1,310 @@
+/* load generator for the art server
+ *   puts the records on one connection, then runs a get, put, delete and
+ *   scan mix on several connections at once. each connection writes a
+ *   batch of requests and reads the replies as they come, and the time
+ *   from the first write to the last reply is the batch's latency.
+ *
+ *   client [-s socket] [-k file|int] [-r records] [-c connections]
+ *          [-n ops] [-b batch] [-m get,put,del,scan] [-x tree]
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "bench.h"
+#include "server.h"
+
+#define MIX 4
+
+#define SCAN_MAX     100
+#define SCAN_PREFIX  3
+#define LOAD_BATCH   256
+#define READ_SIZE    (1 << 16)
+
+static const byte_t mixOps[MIX] = { ART_GET, ART_PUT, ART_DEL, ART_SCAN };
+
+typedef struct {
+  byte_t** keys;
+  int*     lens;
+  int      count;
+  int      mix[MIX];
+  int      batch;
+  int      tree;
+  char*    path;
+} workload;
+
+typedef struct {
+  workload*  w;
+  word_t     rng;
+  int        ops;
+  int        fd;
+  word_t     found;
+  word_t     failed;
+  histogram  hist;
+  byte_t*    out;
+  byte_t*    in;
+  int        inCap;
+  pthread_t  thread;
+} worker;
+
+static int connectTo (char* path) {
+  struct sockaddr_un addr;
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+  if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+    perror(path);
+    exit(1);
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  return fd;
+}
+
+/* appends a request and returns the new end */
+static byte_t* request (byte_t* p, int op, int tree, byte_t* k, int l, word_t v) {
+  artRequest q;
+  memset(&q, 0, sizeof(q));
+  q.op = (byte_t)op;
+  q.tree = (byte_t)tree;
+  q.len = (byte_t)l;
+  q.val = v;
+  memcpy(p, &q, sizeof(q));
+  memcpy(p + sizeof(q), k, l);
+  return p + sizeof(q) + l;
+}
+
+/* the length of the reply chunk at p, scan entries included, or 0 if
+ * it has not all arrived */
+static int chunkLen (byte_t* p, int n) {
+  artReply r, e;
+  unsigned int j;
+  int at = sizeof(r);
+  if (n < at) return 0;
+  memcpy(&r, p, sizeof(r));
+  for (j = 0; j < r.count; j++) {
+    if (n - at < (int)sizeof(e)) return 0;
+    memcpy(&e, p + at, sizeof(e));
+    at += sizeof(e) + e.len;
+    if (at > n) return 0;
+  }
+  return at;
+}
+
+/* writes len bytes of requests and reads the replies to n of them. the
+ * server stops reading while too many replies wait, so both go on at
+ * once. */
+static void exchange (worker* t, byte_t* out, int len, int n) {
+  struct pollfd pfd;
+  artReply r;
+  ssize_t got;
+  int sent = 0, have = 0, used, c;
+
+  while (n > 0) {
+    pfd.fd = t->fd;
+    pfd.events = POLLIN | (sent < len ? POLLOUT : 0);
+    if (poll(&pfd, 1, -1) < 0) {
+      if (errno == EINTR) continue;
+      perror("poll");
+      exit(1);
+    }
+    if (pfd.revents & POLLOUT) {
+      got = write(t->fd, out + sent, len - sent);
+      if (got < 0 && errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) {
+        perror("write");
+        exit(1);
+      }
+      if (got > 0) sent += got;
+    }
+    if (!(pfd.revents & (POLLIN | POLLHUP | POLLERR))) continue;
+    if (have + READ_SIZE > t->inCap) {
+      t->inCap = have + READ_SIZE;
+      if (!(t->in = realloc(t->in, t->inCap))) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+      }
+    }
+    got = read(t->fd, t->in + have, READ_SIZE);
+    if (got < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) continue;
+    if (got <= 0) {
+      fprintf(stderr, "server closed the connection\n");
+      exit(1);
+    }
+    have += got;
+    for (used = 0; n > 0 && (c = chunkLen(t->in + used, have - used)); used += c) {
+      memcpy(&r, t->in + used, sizeof(r));
+      if (r.status == ART_MORE) continue;
+      if (r.status == ART_OK) t->found++;
+      else if (r.status == ART_BAD) t->failed++;
+      n--;
+    }
+    memmove(t->in, t->in + used, have - used);
+    have -= used;
+  }
+}
+
+static void* runWorker (void* arg) {
+  worker* t = arg;
+  workload* w = t->w;
+  byte_t* p;
+  double start;
+  int i, n, r, op, idx, len;
+
+  t->fd = connectTo(w->path);
+  while (t->ops > 0) {
+    n = t->ops < w->batch ? t->ops : w->batch;
+    for (i = 0, p = t->out; i < n; i++) {
+      r = (int)(nextRandom(&t->rng) % 100);
+      for (op = 0; r >= w->mix[op]; op++) r -= w->mix[op];
+      idx = (int)(nextRandom(&t->rng) % w->count);
+      len = w->lens[idx];
+      if (mixOps[op] == ART_SCAN && len > SCAN_PREFIX) len = SCAN_PREFIX;
+      p = request(p, mixOps[op], w->tree, w->keys[idx], len,
+        mixOps[op] == ART_PUT ? nextRandom(&t->rng) | 1 : mixOps[op] == ART_SCAN ? SCAN_MAX : 0);
+    }
+    start = wallClock();
+    exchange(t, t->out, (int)(p - t->out), n);
+    histAdd(&t->hist, (word_t)((wallClock() - start) * 1e9));
+    t->ops -= n;
+  }
+  close(t->fd);
+  return NULL;
+}
+
+static void usage (void) {
+  fprintf(stderr, "usage: client [-s socket] [-k file|int] [-r records] [-c connections]\n"
+                  "              [-n ops] [-b batch] [-m get,put,del,scan] [-x tree]\n");
+  exit(1);
+}
+
+int main (int argc, char** argv) {
+  workload w;
+  worker* workers;
+  histogram total;
+  char* source = "words.txt";
+  int conns = 4, ops = 1000000, records = -1, cap = 0, i, j, b, n;
+  word_t x, done, found = 0, failed = 0;
+  double start, elapsed;
+  byte_t* p;
+  FILE* in;
+
+  signal(SIGPIPE, SIG_IGN);
+  memset(&w, 0, sizeof(w));
+  w.path = ART_SOCKET;
+  w.batch = 64;
+  w.mix[0] = 90;
+  w.mix[1] = 10;
+  for (i = 1; i < argc; i++) {
+    if (i + 1 >= argc) usage();
+    if (!strcmp(argv[i], "-s")) w.path = argv[++i];
+    else if (!strcmp(argv[i], "-k")) source = argv[++i];
+    else if (!strcmp(argv[i], "-r")) records = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-c")) conns = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-n")) ops = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-b")) w.batch = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-x")) w.tree = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-m")) {
+      if (sscanf(argv[++i], "%d,%d,%d,%d", &w.mix[0], &w.mix[1], &w.mix[2], &w.mix[3]) != MIX)
+        usage();
+    }
+    else usage();
+  }
+  for (i = 0, j = 0; i < MIX; i++) j += w.mix[i];
+  if (j != 100 || conns < 1 || ops < 1 || w.batch < 1 || w.tree < 0 || w.tree > 255)
+    usage();
+
+  /* generated integer keys are 8 byte big-endian scrambled counters */
+  if (!strcmp(source, "int")) {
+    w.count = records > 0 ? records : 1000000;
+    w.keys = malloc(w.count * sizeof(byte_t*));
+    w.lens = malloc(w.count * sizeof(int));
+    for (i = 0; i < w.count; i++) {
+      w.keys[i] = malloc(8);
+      w.lens[i] = 8;
+      x = fnv(i);
+      for (j = 0; j < 8; j++) w.keys[i][j] = (byte_t)(x >> (56 - 8 * j));
+    }
+  } else {
+    if (!(in = fopen(source, "r"))) {
+      fprintf(stderr, "cannot open %s\n", source);
+      return 1;
+    }
+    for (;;) {
+      if (w.count == cap) {
+        cap = cap ? cap * 2 : 1024;
+        w.keys = realloc(w.keys, cap * sizeof(byte_t*));
+        w.lens = realloc(w.lens, cap * sizeof(int));
+      }
+      if (!(w.keys[w.count] = readLine(in, &w.lens[w.count]))) break;
+      if (w.lens[w.count] > 0 && w.lens[w.count] < 256) w.count++;
+      else free(w.keys[w.count]);
+    }
+    fclose(in);
+    if (records > 0 && records < w.count) w.count = records;
+  }
+  if (!w.count) usage();
+
+  workers = calloc(conns, sizeof(worker));
+  for (i = 0; i < conns; i++) {
+    workers[i].w = &w;
+    workers[i].rng = fnv(i + 1) | 1;
+    workers[i].ops = ops / conns + (i < ops % conns);
+    n = w.batch > LOAD_BATCH ? w.batch : LOAD_BATCH;
+    workers[i].out = malloc((word_t)n * (sizeof(artRequest) + 255));
+  }
+
+  /* the load goes through the first worker's buffers */
+  workers[0].fd = connectTo(w.path);
+  start = wallClock();
+  for (i = 0; i < w.count; i += b) {
+    b = w.count - i < LOAD_BATCH ? w.count - i : LOAD_BATCH;
+    for (j = 0, p = workers[0].out; j < b; j++)
+      p = request(p, ART_PUT, w.tree, w.keys[i + j], w.lens[i + j], (word_t)i + j + 1);
+    exchange(&workers[0], workers[0].out, (int)(p - workers[0].out), b);
+  }
+  elapsed = wallClock() - start;
+  close(workers[0].fd);
+  printf("loaded %d records from %s in %.3fs, %.0f puts/s\n", w.count, source,
+    elapsed, w.count / elapsed);
+  workers[0].found = workers[0].failed = 0;
+
+  start = wallClock();
+  for (i = 1; i < conns; i++)
+    pthread_create(&workers[i].thread, NULL, runWorker, &workers[i]);
+  runWorker(&workers[0]);
+  for (i = 1; i < conns; i++)
+    pthread_join(workers[i].thread, NULL);
+  elapsed = wallClock() - start;
+
+  memset(&total, 0, sizeof(total));
+  done = ops;
+  for (i = 0; i < conns; i++) {
+    histMerge(&total, &workers[i].hist);
+    found += workers[i].found;
+    failed += workers[i].failed;
+  }
+
+  printf("mix %d,%d,%d,%d, %d connections, batches of %d\n",
+    w.mix[0], w.mix[1], w.mix[2], w.mix[3], conns, w.batch);
+  printf("%lu ops in %.3fs, %.0f ops/s, %lu found, %lu rejected\n",
+    done, elapsed, done / elapsed, found, failed);
+  printf("batch   %9lu      avg %6luns  p50 %6luns  p99 %6luns  p99.9 %7luns  max %8luns\n",
+    total.count, total.total / total.count, histPercentile(&total, 0.5),
+    histPercentile(&total, 0.99), histPercentile(&total, 0.999), total.max);
+  printf("per op  %9lu      avg %6luns\n", done, total.total / done);
+
+  for (i = 0; i < conns; i++) {
+    free(workers[i].out);
+    free(workers[i].in);
+  }
+  free(workers);
+  return 0;
+}
@@ -0,0 +1,130 @@
+/* art::map against std::map and std::unordered_map
+ *   inserts, probes, iterates and erases the same keys in each map and
+ *   checks that the ordered maps agree on iteration order.
+ *
+ *   maps [words file] [integer keys]
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "art.hpp"
+
+static double now () {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static uint64_t mix (uint64_t& s) {
+  uint64_t z = (s += 0x9e3779b97f4a7c15ull);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+template <class M, class K>
+static bool probe (const M& m, const K& k, uint64_t& sum) {
+  auto i = m.find(k);
+  if (i == m.end()) return false;
+  sum += i->second;
+  return true;
+}
+
+template <class K, class V>
+static bool probe (const art::map<K, V>& m, const K& k, uint64_t& sum) {
+  auto v = m.get(k);
+  if (!v) return false;
+  sum += *v;
+  return true;
+}
+
+template <class M>
+static uint64_t walk (const M& m) {
+  uint64_t sum = 0;
+  for (const auto& kv : m) sum += kv.second;
+  return sum;
+}
+
+template <class M, class K>
+static void run (const char* name, const std::vector<K>& keys, const std::vector<K>& probes) {
+  M m;
+  uint64_t sum = 0;
+  std::size_t i, hits = 0;
+  double t;
+
+  t = now();
+  for (i = 0; i < keys.size(); i++)
+    m.insert_or_assign(keys[i], static_cast<typename M::mapped_type>(i + 1));
+  std::printf("  %-20s insert %8.4f", name, now() - t);
+  t = now();
+  for (i = 0; i < probes.size(); i++)
+    hits += probe(m, probes[i], sum);
+  std::printf("  probe %8.4f", now() - t);
+  t = now();
+  sum += walk(m);
+  std::printf("  iterate %8.4f", now() - t);
+  t = now();
+  for (i = 0; i < keys.size(); i += 2)
+    m.erase(keys[i]);
+  std::printf("  erase %8.4f  size %zu hits %zu\n", now() - t, m.size(), hits);
+  if (!sum) std::puts("");
+}
+
+/* both ordered maps must produce the same sequence */
+template <class K, class V>
+static void order (const std::vector<K>& keys) {
+  std::map<K, V> s;
+  art::map<K, V> a;
+  std::size_t i;
+  for (i = 0; i < keys.size(); i++) {
+    s.insert_or_assign(keys[i], static_cast<V>(i));
+    a.insert_or_assign(keys[i], static_cast<V>(i));
+  }
+  auto x = s.begin();
+  auto y = a.begin();
+  for (; x != s.end() && y != a.end(); ++x, ++y)
+    if (x->first != y->first || x->second != y->second) break;
+  std::printf("  order %s, %zu keys, %lu node bytes per key\n",
+    x == s.end() && y == a.end() ? "matches" : "DIFFERS", a.size(),
+    a.size() ? a.tree()->bytes / a.size() : 0);
+}
+
+int main (int argc, char** argv) {
+  std::size_t n = argc > 2 ? std::stoul(argv[2]) : 1000000, i;
+  uint64_t seed = 42;
+  std::vector<uint64_t> ints, intProbes;
+  std::vector<std::string> words, wordProbes;
+  std::vector<std::tuple<uint32_t, std::string>> pairs;
+  std::string line;
+
+  for (i = 0; i < n; i++) ints.push_back(mix(seed));
+  for (i = 0; i < n; i++) intProbes.push_back(ints[mix(seed) % n] + (i & 1));
+  std::printf("%zu random 64 bit keys\n", n);
+  run<art::map<uint64_t, uint64_t>>("art::map", ints, intProbes);
+  run<std::map<uint64_t, uint64_t>>("std::map", ints, intProbes);
+  run<std::unordered_map<uint64_t, uint64_t>>("std::unordered_map", ints, intProbes);
+  order<int64_t, int32_t>(std::vector<int64_t>(ints.begin(), ints.begin() + n / 10));
+
+  if (argc < 2) return 0;
+  std::ifstream in(argv[1]);
+  while (std::getline(in, line))
+    if (!line.empty() && line.size() < 256) words.push_back(line);
+  for (i = 0; i < words.size(); i++) {
+    wordProbes.push_back(words[mix(seed) % words.size()]);
+    pairs.emplace_back(static_cast<uint32_t>(mix(seed) % 1000), words[i]);
+  }
+  std::printf("%zu words from %s\n", words.size(), argv[1]);
+  run<art::map<std::string, uint32_t>>("art::map", words, wordProbes);
+  run<std::map<std::string, uint32_t>>("std::map", words, wordProbes);
+  run<std::unordered_map<std::string, uint32_t>>("std::unordered_map", words, wordProbes);
+  order<std::string, uint32_t>(words);
+  std::printf("%zu (bucket, word) tuple keys\n", pairs.size());
+  order<std::tuple<uint32_t, std::string>, uint16_t>(pairs);
+  return 0;
+}
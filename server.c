@@ -0,0 +1,395 @@
+/* key-value server over a Unix domain socket
+ *   hosts a number of trees, each behind a rwlock. the main thread
+ *   accepts connections and deals them out to worker threads, each of
+ *   which runs an epoll loop over its own connections. every read takes
+ *   as many whole requests as have arrived, and a run of gets and scans,
+ *   or of puts and deletes, on one tree is served under a single lock
+ *   acquisition. see server.h for the protocol.
+ *
+ *   server [-s socket] [-t trees] [-w workers] [-l file]
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+
+#include "server.h"
+
+/* a connection stops reading and serving while this much input waits or
+ * this much output is unsent */
+#define IN_MAX  (1 << 20)
+#define OUT_MAX (1 << 20)
+#define READ_SIZE (1 << 16)
+#define EVENTS 64
+
+typedef struct {
+  Art*             art;
+  pthread_rwlock_t lock;
+} tree;
+
+/* a scan in progress. it stops whenever the output fills and resumes
+ * after the last key it sent once the output drains. */
+typedef struct {
+  artCursor cur;
+  tree*     t;
+  byte_t    prefix[256];
+  int       plen;
+  byte_t    last[256];
+  int       llen;
+  int       resume;
+  word_t    left;
+} scanState;
+
+typedef struct {
+  int        fd;
+  int        events;
+  byte_t*    in;
+  int        inLen;
+  int        inCap;
+  byte_t*    out;
+  int        outLen;
+  int        outPos;
+  int        outCap;
+  int        closing;
+  int        scanning;
+  scanState* scan;
+} conn;
+
+typedef struct {
+  int       ep;
+  pthread_t thread;
+} loop;
+
+static tree* trees;
+static int ntrees = 1;
+
+static void* grow (void* p, int* cap, int need) {
+  if (need <= *cap) return p;
+  while (*cap < need) *cap = *cap ? *cap * 2 : 4096;
+  if (!(p = realloc(p, *cap))) {
+    fprintf(stderr, "Fatal: out of memory.");
+    abort();
+  }
+  return p;
+}
+
+/* replies sit at any offset after variable length keys, so they are
+ * built on the stack and copied out */
+static void append (conn* c, artReply* r, byte_t* k, int l) {
+  c->out = grow(c->out, &c->outCap, c->outLen + (int)sizeof(artReply) + l);
+  memcpy(c->out + c->outLen, r, sizeof(artReply));
+  if (l) memcpy(c->out + c->outLen + sizeof(artReply), k, l);
+  c->outLen += sizeof(artReply) + l;
+}
+
+static void reply (conn* c, int status, word_t val) {
+  artReply r;
+  memset(&r, 0, sizeof(r));
+  r.status = (byte_t)status;
+  r.val = val;
+  append(c, &r, NULL, 0);
+}
+
+/* sends the next chunk of the scan, up to the output limit. the chunk
+ * is ART_MORE while the scan has keys left to send. */
+static void scanMore (conn* c) {
+  scanState* s = c->scan;
+  artCursor* cur = &s->cur;
+  artReply r;
+  int at = c->outLen, skip = s->resume;
+  unsigned int count = 0;
+
+  reply(c, ART_OK, 0);
+  if (s->resume) artCursorSeek(s->t->art, cur, s->last, s->llen);
+  else artCursorSeek(s->t->art, cur, s->prefix, s->plen);
+  while (s->left && c->outLen - c->outPos < OUT_MAX) {
+    if (!artCursorNext(cur) || cur->len < s->plen
+      || memcmp(cur->key, s->prefix, s->plen)) {
+      s->left = 0;
+      break;
+    }
+    /* the key the last chunk ended on, unless it has gone since */
+    if (skip && cur->len == s->llen && !memcmp(cur->key, s->last, s->llen)) {
+      skip = 0;
+      continue;
+    }
+    skip = 0;
+    memset(&r, 0, sizeof(r));
+    r.len = (byte_t)cur->len;
+    r.val = cur->val;
+    append(c, &r, cur->key, cur->len);
+    count++;
+    s->left--;
+  }
+  if (s->left && count) {
+    memcpy(s->last, cur->key, cur->len);
+    s->llen = cur->len;
+    s->resume = 1;
+  }
+  c->scanning = s->left != 0;
+  memcpy(&r, c->out + at, sizeof(r));
+  r.status = c->scanning ? ART_MORE : ART_OK;
+  r.count = count;
+  memcpy(c->out + at, &r, sizeof(r));
+}
+
+static int isWrite (int op) {
+  return op == ART_PUT || op == ART_DEL;
+}
+
+static void serveOne (conn* c, tree* t, artRequest* q, byte_t* k) {
+  word_t v;
+
+  switch (q->op) {
+  case ART_GET:
+    v = artGet(t->art, k, q->len);
+    reply(c, v ? ART_OK : ART_MISSING, v);
+  break;
+  case ART_PUT:
+    reply(c, ART_OK, artExchange(t->art, k, q->len, q->val));
+  break;
+  case ART_DEL:
+    reply(c, artRemove(t->art, k, q->len) ? ART_OK : ART_MISSING, 0);
+  break;
+  case ART_SCAN:
+    if (!c->scan && !(c->scan = malloc(sizeof(scanState)))) {
+      fprintf(stderr, "Fatal: out of memory.");
+      abort();
+    }
+    c->scan->t = t;
+    memcpy(c->scan->prefix, k, q->len);
+    c->scan->plen = q->len;
+    c->scan->resume = 0;
+    c->scan->left = q->val ? q->val : ~(word_t)0;
+    scanMore(c);
+  break;
+  }
+}
+
+static int valid (artRequest* q) {
+  if (q->tree >= ntrees) return 0;
+  if (q->op == ART_PUT) return q->val != 0;
+  return q->op >= ART_GET && q->op <= ART_SCAN;
+}
+
+/* serves whole requests from the input, a run of the same kind on the
+ * same tree per lock, until the input runs out or the output fills */
+static int serve (conn* c) {
+  artRequest q;
+  tree* t;
+  int p = 0, end, served = 0, writer;
+
+  /* a scan cut off by a full output goes on before anything after it */
+  if (c->scanning) {
+    t = c->scan->t;
+    pthread_rwlock_rdlock(&t->lock);
+    scanMore(c);
+    pthread_rwlock_unlock(&t->lock);
+    if (c->scanning) return 1;
+    served++;
+  }
+  while (c->outLen - c->outPos < OUT_MAX) {
+    if (c->inLen - p < (int)sizeof(q)) break;
+    memcpy(&q, c->in + p, sizeof(q));
+    if (c->inLen - p < (int)sizeof(q) + q.len) break;
+    if (!valid(&q)) {
+      reply(c, ART_BAD, 0);
+      p += sizeof(q) + q.len;
+      served++;
+      continue;
+    }
+    t = &trees[q.tree];
+    writer = isWrite(q.op);
+    if (writer) pthread_rwlock_wrlock(&t->lock);
+    else pthread_rwlock_rdlock(&t->lock);
+    for (end = p; ; ) {
+      serveOne(c, t, &q, c->in + end + sizeof(q));
+      end += sizeof(q) + q.len;
+      served++;
+      if (c->outLen - c->outPos >= OUT_MAX || c->inLen - end < (int)sizeof(q))
+        break;
+      memcpy(&q, c->in + end, sizeof(q));
+      if (c->inLen - end < (int)sizeof(q) + q.len || !valid(&q)
+        || &trees[q.tree] != t || isWrite(q.op) != writer) break;
+    }
+    pthread_rwlock_unlock(&t->lock);
+    p = end;
+  }
+  memmove(c->in, c->in + p, c->inLen - p);
+  c->inLen -= p;
+  return served;
+}
+
+/* sends what the socket takes. -1 on a broken connection. */
+static int flush (conn* c) {
+  ssize_t n;
+  while (c->outPos < c->outLen) {
+    n = write(c->fd, c->out + c->outPos, c->outLen - c->outPos);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+    if (n <= 0) return -1;
+    c->outPos += n;
+  }
+  c->outPos = c->outLen = 0;
+  return 0;
+}
+
+static void closeConn (loop* l, conn* c) {
+  epoll_ctl(l->ep, EPOLL_CTL_DEL, c->fd, NULL);
+  close(c->fd);
+  free(c->in);
+  free(c->out);
+  free(c->scan);
+  free(c);
+}
+
+/* reads while output is drained, and waits to write while it is not.
+ * a client that shuts down its end still gets the replies to what it
+ * sent, and the connection closes once they are out. */
+static int handle (conn* c, int events) {
+  ssize_t n;
+  if (events & EPOLLIN) {
+    while (!c->closing && c->inLen < IN_MAX) {
+      c->in = grow(c->in, &c->inCap, c->inLen + READ_SIZE);
+      n = read(c->fd, c->in + c->inLen, READ_SIZE);
+      if (n < 0 && errno == EINTR) continue;
+      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+      if (n < 0) return -1;
+      if (n == 0) c->closing = 1;
+      c->inLen += n;
+    }
+  } else if (!(events & EPOLLOUT)) return -1;
+  do {
+    if (flush(c)) return -1;
+  } while (c->outPos == c->outLen && serve(c));
+  return c->closing && c->outPos == c->outLen ? -1 : 0;
+}
+
+static void* runLoop (void* arg) {
+  loop* l = arg;
+  struct epoll_event ev[EVENTS], mod;
+  conn* c;
+  int i, n, want;
+
+  for (;;) {
+    n = epoll_wait(l->ep, ev, EVENTS, -1);
+    for (i = 0; i < n; i++) {
+      c = ev[i].data.ptr;
+      if (handle(c, ev[i].events)) {
+        closeConn(l, c);
+        continue;
+      }
+      want = c->outPos < c->outLen ? EPOLLOUT : EPOLLIN;
+      if (want != c->events) {
+        c->events = want;
+        mod.events = want;
+        mod.data.ptr = c;
+        epoll_ctl(l->ep, EPOLL_CTL_MOD, c->fd, &mod);
+      }
+    }
+  }
+  return NULL;
+}
+
+static void usage (void) {
+  fprintf(stderr, "usage: server [-s socket] [-t trees] [-w workers] [-l file]\n");
+  exit(1);
+}
+
+int main (int argc, char** argv) {
+  struct sockaddr_un addr;
+  struct epoll_event ev;
+  char *path = ART_SOCKET, *load = NULL;
+  int workers = 2, fd, s, i, next = 0;
+  loop* loops;
+  conn* c;
+
+  for (i = 1; i < argc; i++) {
+    if (i + 1 >= argc) usage();
+    if (!strcmp(argv[i], "-s")) path = argv[++i];
+    else if (!strcmp(argv[i], "-t")) ntrees = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-w")) workers = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-l")) load = argv[++i];
+    else usage();
+  }
+  if (ntrees < 1 || ntrees > 256 || workers < 1 || strlen(path) >= sizeof(addr.sun_path))
+    usage();
+
+  if (!(trees = calloc(ntrees, sizeof(tree)))) {
+    perror("calloc");
+    return 1;
+  }
+  for (i = 0; i < ntrees; i++) {
+    trees[i].art = artNewPrivate();
+    pthread_rwlock_init(&trees[i].lock, NULL);
+  }
+  if (load) printf("loaded %d keys from %s into tree 0\n",
+    artLoadLines(trees[0].art, load, NULL, NULL), load);
+
+  signal(SIGPIPE, SIG_IGN);
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  unlink(path);
+  if ((s = socket(AF_UNIX, SOCK_STREAM, 0)) < 0
+    || bind(s, (struct sockaddr *)&addr, sizeof(addr))
+    || listen(s, 128)) {
+    perror(path);
+    return 1;
+  }
+
+  if (!(loops = calloc(workers, sizeof(loop)))) {
+    perror("calloc");
+    return 1;
+  }
+  for (i = 0; i < workers; i++) {
+    if ((loops[i].ep = epoll_create(EVENTS)) < 0) {
+      perror("epoll_create");
+      return 1;
+    }
+    /* pthread_create returns its error rather than setting errno */
+    if ((errno = pthread_create(&loops[i].thread, NULL, runLoop, &loops[i]))) {
+      perror("pthread_create");
+      return 1;
+    }
+  }
+  printf("serving %d trees on %s with %d workers\n", ntrees, path, workers);
+  fflush(stdout);
+
+  for (;;) {
+    if ((fd = accept(s, NULL, NULL)) < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      perror("accept");
+      return 1;
+    }
+    /* a connection that cannot be set up is refused, not left unserved */
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    if (!(c = calloc(1, sizeof(conn)))) {
+      perror("calloc");
+      close(fd);
+      continue;
+    }
+    c->fd = fd;
+    c->events = EPOLLIN;
+    ev.events = EPOLLIN;
+    ev.data.ptr = c;
+    if (epoll_ctl(loops[next].ep, EPOLL_CTL_ADD, fd, &ev)) {
+      perror("epoll_ctl");
+      close(fd);
+      free(c);
+      continue;
+    }
+    next = (next + 1) % workers;
+  }
+  return 0;
+}
@@ -0,0 +1,55 @@
+/* wire protocol of the art server
+ *   both ends share a host, so headers are sent in host byte order. a
+ *   request is an artRequest followed by len key bytes. a client may
+ *   send any number of requests before it reads, and replies come back
+ *   in request order, each an artReply. a scan's reply carries count
+ *   entries after it, each an artReply holding a key's length and value
+ *   followed by the key. values are the server's word_t.
+ *
+ *   the server stops reading while a connection has a megabyte of
+ *   replies unsent, so a client must read replies as it writes. a long
+ *   scan comes in chunks of about that size, each with status ART_MORE
+ *   but the last. between chunks the tree may change: keys still come
+ *   in order and at most once, but are not from one moment.
+ *
+ *   get    val is the key's value, status ART_MISSING if it has none
+ *   put    val is the value to put, not 0. the reply holds the old one
+ *   del    status ART_MISSING if the key was absent
+ *   scan   the key is a prefix and val the most keys to return, 0 for
+ *          all of them, in key order
+ */
+
+#ifndef _ART_SERVER_H
+#define _ART_SERVER_H
+
+#include "art.h"
+
+#define ART_SOCKET "/tmp/art.sock"
+
+#define ART_GET  1
+#define ART_PUT  2
+#define ART_DEL  3
+#define ART_SCAN 4
+
+#define ART_OK      0
+#define ART_MISSING 1
+#define ART_BAD     2
+#define ART_MORE    3
+
+typedef struct {
+  byte_t op;
+  byte_t tree;
+  byte_t len;
+  byte_t pad[5];
+  word_t val;
+} artRequest;
+
+typedef struct {
+  byte_t       status;
+  byte_t       len;
+  byte_t       pad[2];
+  unsigned int count;
+  word_t       val;
+} artReply;
+
+#endif
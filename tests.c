@@ -1,3 +1,5 @@
+#define _POSIX_C_SOURCE 200112L
+
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -117,6 +119,894 @@ void numberBench (Art* d) {
   printf("Finshed in %f.\n", end-start);
 }
 
+void longKeyBench (Art* d) {
+  byte_t key[240];
+  double end, start;
+  int i, j, n = 200000, wc = 0;
+  memset(key, 'k', sizeof(key));
+  start = (float)clock()/CLOCKS_PER_SEC;
+  for (i = 0; i < n; i++) {
+    sprintf((char *)key + 200, "%08x", i * 2654435761u);
+    artPut(d, key, 208, (word_t)"val");
+  }
+  end = (float)clock()/CLOCKS_PER_SEC;
+  printf("Inserted %d keys of 208 bytes.\n", n);
+  printf("Total: %lu bytes.\n", bytes);
+  printf("Finshed in %f.\n", end-start);
+  start = (float)clock()/CLOCKS_PER_SEC;
+  for (j = 0; j < 10; j++) {
+    for (i = 0; i < n; i++) {
+      sprintf((char *)key + 200, "%08x", i * 2654435761u);
+      if (artGet(d, key, 208)) wc++;
+    }
+  }
+  end = (float)clock()/CLOCKS_PER_SEC;
+  printf("Retrieved %d keys.\n", wc);
+  printf("Finshed in %f.\n", end-start);
+}
+
+Art* loadFile (char* file) {
+  FILE* in = fopen(file, "r");
+  Art* d = artNew();
+  byte_t* word;
+  while ((word = getWord(in))) {
+    artPut(d, word, strlen((char *)word), (word_t)word);
+  }
+  fclose(in);
+  return d;
+}
+
+int joinVisitor (void* ctx, byte_t* k, int l, word_t a, word_t b) {
+  *(int *)ctx += 1;
+  return 0;
+}
+
+void joinBench (char* f0, char* f1) {
+  Art *a = loadFile(f0), *b = loadFile(f1);
+  FILE* in;
+  byte_t* word;
+  double end, start;
+  int wc = 0;
+
+  start = (float)clock()/CLOCKS_PER_SEC;
+  artIntersect(a, b, joinVisitor, &wc);
+  end = (float)clock()/CLOCKS_PER_SEC;
+  printf("Intersected %d keys.\n", wc);
+  printf("Finshed in %f.\n", end-start);
+
+  wc = 0;
+  in = fopen(f0, "r");
+  start = (float)clock()/CLOCKS_PER_SEC;
+  while ((word = getWord(in))) {
+    if (artGet(b, word, strlen((char *)word))) wc++;
+    free(word);
+  }
+  end = (float)clock()/CLOCKS_PER_SEC;
+  fclose(in);
+  printf("Probed %d keys.\n", wc);
+  printf("Finshed in %f.\n", end-start);
+}
+
+int countVisitor (void* ctx, byte_t* k, int l, word_t v) {
+  return 0;
+}
+
+void scanBench (char* file, int nthreads) {
+  Art* d = loadFile(file);
+  double end, start;
+  int ordered;
+  for (ordered = 0; ordered < 2; ordered++) {
+    start = (float)clock()/CLOCKS_PER_SEC;
+    artScanParallel(d, (byte_t *)"", 0, countVisitor, NULL, nthreads, ordered);
+    end = (float)clock()/CLOCKS_PER_SEC;
+    printf("%s scan on %d threads.\n", ordered ? "Ordered" : "Unordered", nthreads);
+    printf("Finshed in %f cpu seconds.\n", end-start);
+  }
+}
+
+void optimizeBench (char* file) {
+  Art* d = loadFile(file);
+  FILE* in = fopen(file, "r");
+  byte_t* word;
+  double end, start;
+  word_t freed;
+  int wc = 0;
+
+  while ((word = getWord(in))) {
+    if (wc++ % 10) artRemove(d, word, strlen((char *)word));
+    free(word);
+  }
+  fclose(in);
+  printf("Removed 90%% of %d keys, %lu bytes left.\n", wc, bytes);
+  start = (float)clock()/CLOCKS_PER_SEC;
+  freed = artOptimize(d);
+  end = (float)clock()/CLOCKS_PER_SEC;
+  printf("Reclaimed %lu bytes, %lu left.\n", freed, bytes);
+  printf("Finshed in %f.\n", end-start);
+}
+
+typedef struct {
+  byte_t* q;
+  int     len;
+  int     max;
+  int     hits;
+} fuzzyQuery;
+
+int fuzzyVisitor (void* ctx, byte_t* k, int l, word_t v) {
+  ((fuzzyQuery *)ctx)->hits++;
+  return 0;
+}
+
+/* the baseline: full levenshtein distance against every key */
+int bruteVisitor (void* ctx, byte_t* k, int l, word_t v) {
+  fuzzyQuery* f = ctx;
+  int rows[2][256], i, j, c, *prev, *row;
+  for (j = 0; j <= f->len; j++) rows[0][j] = j;
+  for (i = 1; i <= l; i++) {
+    prev = rows[(i - 1) & 1];
+    row = rows[i & 1];
+    row[0] = i;
+    for (j = 1; j <= f->len; j++) {
+      c = prev[j - 1] + (k[i - 1] != f->q[j - 1]);
+      if (prev[j] + 1 < c) c = prev[j] + 1;
+      if (row[j - 1] + 1 < c) c = row[j - 1] + 1;
+      row[j] = c;
+    }
+  }
+  if (rows[l & 1][f->len] <= f->max) f->hits++;
+  return 0;
+}
+
+void fuzzyBench (char* file) {
+  Art* d = loadFile(file);
+  FILE* in = fopen(file, "r");
+  byte_t* words[100];
+  byte_t* word;
+  double end, start;
+  fuzzyQuery f;
+  int n = 0, wc = 0, i, max;
+
+  /* every 1000th key with its middle byte changed */
+  while (n < 100 && (word = getWord(in))) {
+    if (wc++ % 1000 || !word[0]) {
+      free(word);
+      continue;
+    }
+    word[strlen((char *)word) / 2] = 'q';
+    words[n++] = word;
+  }
+  fclose(in);
+
+  for (max = 1; max <= 2; max++) {
+    f.max = max;
+    f.hits = 0;
+    start = (float)clock()/CLOCKS_PER_SEC;
+    for (i = 0; i < n; i++) {
+      f.q = words[i];
+      f.len = strlen((char *)words[i]);
+      artFuzzySearch(d, f.q, f.len, max, fuzzyVisitor, &f);
+    }
+    end = (float)clock()/CLOCKS_PER_SEC;
+    printf("Distance %d: %d matches for %d queries.\n", max, f.hits, n);
+    printf("Finshed in %f.\n", end-start);
+
+    f.hits = 0;
+    start = (float)clock()/CLOCKS_PER_SEC;
+    for (i = 0; i < n; i++) {
+      f.q = words[i];
+      f.len = strlen((char *)words[i]);
+      artScan(d, (byte_t *)"", 0, bruteVisitor, &f);
+    }
+    end = (float)clock()/CLOCKS_PER_SEC;
+    printf("Brute force: %d matches.\n", f.hits);
+    printf("Finshed in %f.\n", end-start);
+  }
+}
+
+/* a stable pseudo score derived from the key text */
+word_t wordScore (word_t v) {
+  byte_t* w = (byte_t *)v;
+  word_t h = 5381;
+  while (*w) h = h * 33 + *w++;
+  return h % 1000000;
+}
+
+int scoreCompare (const void* a, const void* b) {
+  word_t x = wordScore(((artVal *)a)->val), y = wordScore(((artVal *)b)->val);
+  return x < y ? 1 : x > y ? -1 : 0;
+}
+
+void topBench (char* file) {
+  Art* d = artNewScored(wordScore);
+  FILE* in = fopen(file, "r");
+  artVal out[10], *vals, *v, *all = NULL;
+  byte_t* word;
+  byte_t p[1];
+  double end, start;
+  int i, n, cnt, cap = 0, same = 1;
+
+  start = (float)clock()/CLOCKS_PER_SEC;
+  while ((word = getWord(in)))
+    artPut(d, word, strlen((char *)word), (word_t)word);
+  end = (float)clock()/CLOCKS_PER_SEC;
+  fclose(in);
+  printf("Loaded scored tree in %f.\n", end-start);
+
+  start = (float)clock()/CLOCKS_PER_SEC;
+  for (p[0] = 'a'; p[0] <= 'z'; p[0]++) {
+    n = artTopK(d, p, 1, 10, out);
+    for (i = 0; i < n; i++) free(out[i].key);
+  }
+  end = (float)clock()/CLOCKS_PER_SEC;
+  printf("Top 10 for 26 prefixes.\n");
+  printf("Finshed in %f.\n", end-start);
+
+  start = (float)clock()/CLOCKS_PER_SEC;
+  for (p[0] = 'a'; p[0] <= 'z'; p[0]++) {
+    vals = artGetWithPrefix(d, p, 1);
+    for (cnt = 0, v = vals; v; v = v->next, cnt++) {
+      if (cnt == cap) all = realloc(all, (cap = cap ? cap * 2 : 1024) * sizeof(artVal));
+      all[cnt] = *v;
+    }
+    qsort(all, cnt, sizeof(artVal), scoreCompare);
+    n = artTopK(d, p, 1, 10, out);
+    for (i = 0; i < n; i++) {
+      if (wordScore(out[i].val) != wordScore(all[i].val)) same = 0;
+      free(out[i].key);
+    }
+    while (vals) {
+      v = vals->next;
+      free(vals->key);
+      free(vals);
+      vals = v;
+    }
+  }
+  end = (float)clock()/CLOCKS_PER_SEC;
+  printf("Collect and sort baseline, %s.\n", same ? "same scores" : "MISMATCH");
+  printf("Finshed in %f.\n", end-start);
+}
+
+/* routes are stored one byte per address bit, so prefixes of any bit
+ * length are plain keys */
+void routeBits (byte_t* key, byte_t* addr, int bits) {
+  int i;
+  for (i = 0; i < bits; i++)
+    key[i] = (addr[i >> 3] >> (7 - (i & 7))) & 1;
+}
+
+void routeBench (int n) {
+  Art* d = artNew();
+  byte_t* table = malloc(n * 16);
+  int* lens = malloc(n * sizeof(int));
+  byte_t key[128], bits[128], addr[16];
+  double end, start;
+  int fam, i, j, width, m, best, bad = 0, probes = 1000000;
+  word_t v, sum = 0;
+
+  srand(42);
+  for (fam = 0; fam < 2; fam++) {
+    width = fam ? 128 : 32;
+    for (i = 0; i < n; i++) {
+      for (j = 0; j < 16; j++) table[i * 16 + j] = rand() & 0xff;
+      if (fam) lens[i] = rand() % 3 ? 48 : 16 + rand() % 49;
+      else lens[i] = rand() % 5 < 3 ? 24 : 8 + rand() % 25;
+      routeBits(key, table + i * 16, lens[i]);
+      artPut(d, key, lens[i], i + 1);
+    }
+
+    /* addresses inside a random route, so every lookup has an answer */
+    start = (float)clock()/CLOCKS_PER_SEC;
+    for (i = 0; i < probes; i++) {
+      memcpy(addr, table + (word_t)i * 7919 % n * 16, 16);
+      addr[15] ^= i;
+      routeBits(key, addr, width);
+      sum += artLongestPrefix(d, key, width, &m);
+    }
+    end = (float)clock()/CLOCKS_PER_SEC;
+    printf("IPv%d: %d routes, %d longest prefix lookups.\n", fam ? 6 : 4, n, probes);
+    printf("Finshed in %f.\n", end-start);
+
+    /* the same lookups as one exact probe per prefix length */
+    start = (float)clock()/CLOCKS_PER_SEC;
+    for (i = 0; i < probes; i++) {
+      memcpy(addr, table + (word_t)i * 7919 % n * 16, 16);
+      addr[15] ^= i;
+      routeBits(key, addr, width);
+      for (j = width; j > 0 && !(v = artGet(d, key, j)); j--);
+      if (i < 200) {
+        for (best = j = 0; j < n; j++) {
+          if (lens[j] <= best) continue;
+          routeBits(bits, table + j * 16, lens[j]);
+          if (!memcmp(bits, key, lens[j])) best = lens[j];
+        }
+        artLongestPrefix(d, key, width, &m);
+        if (m != best) bad++;
+      }
+      sum -= v;
+    }
+    end = (float)clock()/CLOCKS_PER_SEC;
+    printf("Per length probing, %s.\n", sum || bad ? "MISMATCH" : "same routes");
+    printf("Finshed in %f.\n", end-start);
+
+    for (i = 0; i < n; i++) {
+      routeBits(key, table + i * 16, lens[i]);
+      artRemove(d, key, lens[i]);
+    }
+  }
+  free(table);
+  free(lens);
+}
+
+double wallClock (void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+int latencyCompare (const void* a, const void* b) {
+  double x = *(double *)a, y = *(double *)b;
+  return x < y ? -1 : x > y;
+}
+
+void latencyReport (char* what, double* lat, int n) {
+  qsort(lat, n, sizeof(double), latencyCompare);
+  printf("%s: p50 %.0fns p99 %.0fns p99.9 %.0fns max %.0fns\n", what,
+    lat[n / 2] * 1e9, lat[n / 100 * 99] * 1e9, lat[n / 1000 * 999] * 1e9, lat[n - 1] * 1e9);
+}
+
+void removeBench (char* file) {
+  Art *d = loadFile(file), *lazy = loadFile(file);
+  FILE* in = fopen(file, "r");
+  byte_t** words = NULL;
+  byte_t* word;
+  double* lat;
+  double t, start;
+  int n = 0, cap = 0, i, l;
+
+  while ((word = getWord(in))) {
+    if (n == cap) words = realloc(words, (cap = cap ? cap * 2 : 1024) * sizeof(byte_t*));
+    words[n++] = word;
+  }
+  fclose(in);
+  lat = malloc(n * sizeof(double));
+
+  for (i = 0; i < n; i++) {
+    l = strlen((char *)words[i]);
+    t = wallClock();
+    artGet(d, words[i], l);
+    lat[i] = wallClock() - t;
+  }
+  latencyReport("artGet", lat, n);
+
+  for (i = 0; i < n; i++) {
+    l = strlen((char *)words[i]);
+    t = wallClock();
+    artRemove(d, words[i], l);
+    lat[i] = wallClock() - t;
+  }
+  latencyReport("artRemove", lat, n);
+
+  for (i = 0; i < n; i++) {
+    l = strlen((char *)words[i]);
+    t = wallClock();
+    artRemoveLazy(lazy, words[i], l);
+    lat[i] = wallClock() - t;
+  }
+  latencyReport("artRemoveLazy", lat, n);
+
+  start = wallClock();
+  for (i = 0; artMaintenance(lazy, 1000); i++);
+  printf("Maintenance in %d rounds of 1000 keys.\n", i + 1);
+  printf("Finshed in %f.\n", wallClock() - start);
+}
+
+void buildBench (char* file, int nthreads) {
+  FILE* in = fopen(file, "r");
+  byte_t** keys = NULL;
+  int* lens = NULL;
+  word_t* vals = NULL;
+  byte_t* word;
+  int n = 0, cap = 0, i, miss = 0;
+  double end, start;
+  Art* d;
+
+  while ((word = getWord(in))) {
+    if (n == cap) {
+      cap = cap ? cap * 2 : 1024;
+      keys = realloc(keys, cap * sizeof(byte_t*));
+      lens = realloc(lens, cap * sizeof(int));
+      vals = realloc(vals, cap * sizeof(word_t));
+    }
+    keys[n] = word;
+    lens[n] = strlen((char *)word);
+    vals[n] = (word_t)word;
+    n++;
+  }
+  fclose(in);
+
+  start = wallClock();
+  d = artNew();
+  for (i = 0; i < n; i++)
+    artPut(d, keys[i], lens[i], vals[i]);
+  end = wallClock();
+  printf("Inserted %d keys.\n", n);
+  printf("Finshed in %f.\n", end-start);
+
+  start = wallClock();
+  d = artBuildParallel(keys, lens, vals, n, nthreads);
+  end = wallClock();
+  for (i = 0; i < n; i++)
+    if (!artGet(d, keys[i], lens[i])) miss++;
+  printf("Built %d keys on %d threads, %d missing.\n", n, nthreads, miss);
+  printf("Finshed in %f.\n", end-start);
+}
+
+void fixedBench (int n) {
+  byte_t* keys = malloc((word_t)n * 8);
+  word_t x = 88172645463325252UL, before;
+  int i, j, fixed, miss;
+  double start;
+  Art* d;
+
+  for (i = 0; i < n; i++) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    for (j = 0; j < 8; j++) keys[i * 8 + j] = (byte_t)(x >> (56 - 8 * j));
+  }
+  for (fixed = 0; fixed < 2; fixed++) {
+    before = bytes;
+    d = fixed ? artNewFixed(8) : artNew();
+    start = wallClock();
+    for (i = 0; i < n; i++)
+      artPut(d, keys + i * 8, 8, i + 1);
+    printf("%s: inserted %d keys in %f, %lu bytes per key.\n",
+      fixed ? "fixed" : "variable", n, wallClock() - start, (bytes - before) / n);
+    start = wallClock();
+    for (i = miss = 0; i < n; i++)
+      if (artGet(d, keys + (word_t)i * 7919 % n * 8, 8) != (word_t)i * 7919 % n + 1) miss++;
+    printf("  probed in %f, %d missing.\n", wallClock() - start, miss);
+    artFree(d);
+  }
+  free(keys);
+}
+
+/* random 8 byte keys, then keys sharing a 9 byte prefix, which tie on
+ * every byte the buffer's radix pass looks at */
+void bufferBench (int n, int cap) {
+  byte_t* keys = malloc((word_t)n * 18);
+  word_t x = 88172645463325252UL;
+  int i, j, l, pass, shape, miss;
+  double start;
+  Art* d;
+
+  for (shape = 0; shape < 2; shape++) {
+    l = shape ? 17 : 8;
+    for (i = 0; i < n; i++) {
+      if (shape) {
+        sprintf((char *)keys + i * l, "commonpfx%08x", (unsigned int)(i * 2654435761UL));
+        continue;
+      }
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+      for (j = 0; j < 8; j++) keys[i * l + j] = (byte_t)(x >> (56 - 8 * j));
+    }
+    printf("%s keys:\n", shape ? "shared prefix" : "random");
+    for (pass = 0; pass < 2; pass++) {
+      d = artNew();
+      if (pass) artSetBuffer(d, cap);
+      start = wallClock();
+      for (i = 0; i < n; i++)
+        artPut(d, keys + i * l, l, i + 1);
+      artFlush(d);
+      printf("  %s: inserted %d keys in %f.\n",
+        pass ? "buffered" : "direct", n, wallClock() - start);
+      /* half the buffer pending, so gets see both sides */
+      for (i = 0; i < cap / 2 && i < n; i++)
+        artPut(d, keys + i * l, l, i + 1);
+      start = wallClock();
+      for (i = miss = 0; i < n; i++)
+        if (artGet(d, keys + (word_t)i * 7919 % n * l, l) != (word_t)i * 7919 % n + 1) miss++;
+      printf("    probed in %f, %d missing.\n", wallClock() - start, miss);
+      start = wallClock();
+      for (i = 0; i < n; i += 2)
+        artRemove(d, keys + i * l, l);
+      artFlush(d);
+      printf("    removed half in %f.\n", wallClock() - start);
+      artFree(d);
+    }
+  }
+  free(keys);
+}
+
+typedef struct {
+  byte_t last[256];
+  int    len;
+  int    count;
+  int    unordered;
+} codecScan;
+
+int codecVisitor (void* ctx, byte_t* k, int l, word_t v) {
+  codecScan* c = ctx;
+  int m = l < c->len ? l : c->len, r = memcmp(c->last, k, m);
+  if (c->count++ && (r > 0 || (!r && c->len >= l))) c->unordered++;
+  memcpy(c->last, k, l);
+  c->len = l;
+  return 0;
+}
+
+void codecBench (char* file, char* name) {
+  FILE* in = fopen(file, "r");
+  byte_t** keys = NULL;
+  int* lens = NULL;
+  byte_t* word;
+  int n = 0, cap = 0, i, pass, miss;
+  double start;
+  word_t before;
+  codecScan c;
+  artCodec* codec = !strcmp(name, "hex") ? &artCodecHex :
+                    !strcmp(name, "alpha") ? &artCodecAlpha :
+                    !strcmp(name, "decimal") ? &artCodecDecimal : &artCodecUUID;
+  Art* d;
+
+  while ((word = getWord(in))) {
+    if (n == cap) {
+      cap = cap ? cap * 2 : 1024;
+      keys = realloc(keys, cap * sizeof(byte_t*));
+      lens = realloc(lens, cap * sizeof(int));
+    }
+    keys[n] = word;
+    lens[n] = strlen((char *)word);
+    n++;
+  }
+  fclose(in);
+
+  for (pass = 0; pass < 2; pass++) {
+    before = bytes;
+    d = artNew();
+    if (pass) artSetCodec(d, codec);
+    start = wallClock();
+    for (i = 0; i < n; i++)
+      artPut(d, keys[i], lens[i], (word_t)keys[i]);
+    printf("%s: inserted %d keys in %f, %lu bytes per key.\n",
+      pass ? name : "raw", n, wallClock() - start, (bytes - before) / n);
+    start = wallClock();
+    for (i = miss = 0; i < n; i++)
+      if (artGet(d, keys[i], lens[i]) != (word_t)keys[i]) miss++;
+    printf("  probed in %f, %d missing.\n", wallClock() - start, miss);
+    memset(&c, 0, sizeof(c));
+    start = wallClock();
+    artScan(d, (byte_t *)"", 0, codecVisitor, &c);
+    printf("  scanned %d keys in %f, %d out of order.\n",
+      c.count, wallClock() - start, c.unordered);
+  }
+}
+
+void freezeBench (char* file, char* image) {
+  FILE* in = fopen(file, "r");
+  byte_t** keys = NULL;
+  int* lens = NULL;
+  byte_t* word;
+  int n = 0, cap = 0, i, pass, miss, j;
+  double start;
+  word_t before = bytes;
+  codecScan c;
+  artFrozen *f, *m;
+  Art* d = artNew();
+
+  while ((word = getWord(in))) {
+    if (n == cap) {
+      cap = cap ? cap * 2 : 1024;
+      keys = realloc(keys, cap * sizeof(byte_t*));
+      lens = realloc(lens, cap * sizeof(int));
+    }
+    keys[n] = word;
+    lens[n] = strlen((char *)word);
+    artPut(d, keys[n], lens[n], n + 1);
+    n++;
+  }
+  fclose(in);
+
+  start = wallClock();
+  f = artFreeze(d);
+  printf("Froze %lu keys in %f: %lu node bytes, %lu frozen bytes.\n",
+    f->count, wallClock() - start, bytes - before, f->size);
+  if (!artFrozenSave(f, image) || !(m = artFrozenLoad(image))) {
+    printf("Could not save and map %s.\n", image);
+    return;
+  }
+  for (pass = 0; pass < 3; pass++) {
+    start = wallClock();
+    for (i = miss = 0; i < n; i++) {
+      j = (word_t)i * 7919 % n;
+      if ((pass == 0 ? artGet(d, keys[j], lens[j]) :
+           artFrozenGet(pass == 1 ? f : m, keys[j], lens[j])) != (word_t)j + 1) miss++;
+    }
+    printf("%s: probed in %f, %d missing.\n",
+      pass == 0 ? "tree" : pass == 1 ? "frozen" : "mapped", wallClock() - start, miss);
+  }
+  memset(&c, 0, sizeof(c));
+  start = wallClock();
+  artFrozenScan(m, (byte_t *)"", 0, codecVisitor, &c);
+  printf("mapped: scanned %d keys in %f, %d out of order.\n",
+    c.count, wallClock() - start, c.unordered);
+  artFrozenFree(f);
+  artFrozenFree(m);
+  artFree(d);
+}
+
+/* misses come in two kinds: random uuids, which leave the tree a few
+ * levels down, and stored keys with the last digit changed, which
+ * fail at the leaf */
+void filterBench (char* file) {
+  FILE* in = fopen(file, "r");
+  byte_t **keys = NULL, **miss;
+  byte_t* word;
+  int n = 0, cap = 0, i, j, pass, kind, found;
+  word_t x = 88172645463325252UL;
+  double start;
+  Art* d = artNew();
+
+  while ((word = getWord(in))) {
+    if (n == cap) {
+      cap = cap ? cap * 2 : 1024;
+      keys = realloc(keys, cap * sizeof(byte_t*));
+    }
+    keys[n] = word;
+    artPut(d, word, strlen((char *)word), n + 1);
+    n++;
+  }
+  fclose(in);
+  miss = malloc(2 * n * sizeof(byte_t*));
+  for (i = 0; i < 2 * n; i++) {
+    miss[i] = malloc(37);
+    if (i < n) {
+      for (j = 0; j < 36; j++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        miss[i][j] = (j == 8 || j == 13 || j == 18 || j == 23) ? '-' :
+                     "0123456789abcdef"[x & 15];
+      }
+      miss[i][36] = 0;
+    } else {
+      strcpy((char *)miss[i], (char *)keys[i - n]);
+      j = strlen((char *)miss[i]) - 1;
+      miss[i][j] = miss[i][j] == '0' ? '1' : '0';
+    }
+  }
+  for (pass = 0; pass < 2; pass++) {
+    if (pass) artSetFilter(d, 1);
+    printf("%s:\n", pass ? "filter" : "no filter");
+    for (kind = 0; kind < 3; kind++) {
+      start = wallClock();
+      for (i = found = 0; i < n; i++) {
+        word = kind ? miss[(kind - 1) * n + i] : keys[i];
+        if (artGet(d, word, strlen((char *)word))) found++;
+      }
+      printf("  %s: %d probes in %f, %d found.\n",
+        kind == 0 ? "stored keys" : kind == 1 ? "random misses" : "near misses",
+        n, wallClock() - start, found);
+    }
+  }
+  printf("filter: %lu bytes, %lu keys.\n",
+    (d->filter->mask + 1) * 32, d->filter->keys);
+  for (i = 0; i < 2 * n; i++) free(miss[i]);
+  free(miss);
+}
+
+int feedCopy (void* ctx, byte_t* k, int l, word_t v) {
+  artPut(ctx, k, l, v);
+  return 0;
+}
+
+void feedBench (char* file, int changes) {
+  FILE* in = fopen(file, "r");
+  byte_t** keys = NULL;
+  byte_t* word;
+  int n = 0, cap = 0, i, j, got, batches = 0;
+  word_t x = 88172645463325252UL, seq;
+  artChange* batch = malloc(256 * sizeof(artChange));
+  double start;
+  Art *d = artNew(), *r = artNew();
+
+  artSetFeed(d, changes);
+  while ((word = getWord(in))) {
+    if (n == cap) {
+      cap = cap ? cap * 2 : 1024;
+      keys = realloc(keys, cap * sizeof(byte_t*));
+    }
+    keys[n] = word;
+    artPut(d, word, strlen((char *)word), n + 1);
+    n++;
+  }
+  fclose(in);
+
+  seq = artFeedSeq(d);
+  start = wallClock();
+  artScan(d, (byte_t *)"", 0, feedCopy, r);
+  printf("Copied %d keys to the replica in %f.\n", n, wallClock() - start);
+  for (i = 0; i < changes; i++) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    j = x % n;
+    if (x & 256) artRemove(d, keys[j], strlen((char *)keys[j]));
+    else artPut(d, keys[j], strlen((char *)keys[j]), x);
+  }
+  start = wallClock();
+  while ((got = artFeedRead(d, &seq, batch, 256)) > 0) {
+    artFeedApply(r, batch, got);
+    batches++;
+  }
+  printf("Caught up on %d changes in %d batches in %f%s.\n", changes, batches,
+    wallClock() - start, got < 0 ? ", feed overflowed" : "");
+  free(batch);
+  artFree(r);
+  artFree(d);
+}
+
+void cacheEvicted (void* ctx, byte_t* k, int l, word_t v) {
+  (*(int *)ctx)++;
+}
+
+/* get, and put on a miss, with keys drawn so that low indexes are hot */
+void cacheBench (char* file, int kb) {
+  FILE* in = fopen(file, "r");
+  byte_t** keys = NULL;
+  byte_t* word;
+  int n = 0, cap = 0, i, j, pass, hits, evicted;
+  word_t x = 88172645463325252UL, peak;
+  double start, u;
+  Art* d;
+
+  while ((word = getWord(in))) {
+    if (n == cap) {
+      cap = cap ? cap * 2 : 1024;
+      keys = realloc(keys, cap * sizeof(byte_t*));
+    }
+    keys[n++] = word;
+  }
+  fclose(in);
+
+  for (pass = 0; pass < 2; pass++) {
+    evicted = hits = 0;
+    peak = 0;
+    d = pass ? artNewCache((word_t)kb * 1024, cacheEvicted, &evicted) : artNew();
+    start = wallClock();
+    for (i = 0; i < 2000000; i++) {
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+      u = (double)(x >> 11) / 9007199254740992.0;
+      j = (int)(u * u * u * n);
+      if (artGet(d, keys[j], strlen((char *)keys[j]))) hits++;
+      else artPut(d, keys[j], strlen((char *)keys[j]), j + 1);
+      if (d->bytes > peak) peak = d->bytes;
+    }
+    printf("%s: 2000000 requests in %f, %.1f%% hits, %lu peak bytes, %d evicted.\n",
+      pass ? "cache" : "unbounded", wallClock() - start, 100.0 * hits / 2000000, peak, evicted);
+    artFree(d);
+  }
+}
+
+/* time ordered keys: a 64 bit stamp in big endian order, then the same
+ * stamps probed in order and in a scrambled order */
+void fingerBench (int n) {
+  byte_t* keys = malloc((word_t)n * 8);
+  word_t t = 1500000000000UL, x = 88172645463325252UL;
+  int i, j, pass, miss;
+  double start;
+  artFinger* f = malloc(sizeof(artFinger));
+  Art* d;
+
+  for (i = 0; i < n; i++) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    t += 1 + x % 16;
+    for (j = 0; j < 8; j++) keys[i * 8 + j] = (byte_t)(t >> (56 - 8 * j));
+  }
+  for (pass = 0; pass < 2; pass++) {
+    memset(f, 0, sizeof(artFinger));
+    d = artNew();
+    start = wallClock();
+    for (i = 0; i < n; i++) {
+      if (pass) artPutFinger(d, f, keys + i * 8, 8, i + 1);
+      else artPut(d, keys + i * 8, 8, i + 1);
+    }
+    printf("%s: inserted %d keys in %f.\n", pass ? "finger" : "root", n, wallClock() - start);
+    start = wallClock();
+    for (i = miss = 0; i < n; i++)
+      if ((pass ? artGetFinger(d, f, keys + i * 8, 8) : artGet(d, keys + i * 8, 8)) != (word_t)i + 1) miss++;
+    printf("  probed in order in %f, %d missing.\n", wallClock() - start, miss);
+    start = wallClock();
+    for (i = miss = 0; i < n; i++) {
+      j = (word_t)i * 7919 % n;
+      if ((pass ? artGetFinger(d, f, keys + j * 8, 8) : artGet(d, keys + j * 8, 8)) != (word_t)j + 1) miss++;
+    }
+    printf("  probed scrambled in %f, %d missing.\n", wallClock() - start, miss);
+    artFree(d);
+  }
+  free(f);
+  free(keys);
+}
+
+int merkleCount (void* ctx, byte_t* k, int l, word_t a, word_t b) {
+  (*(int *)ctx)++;
+  return 0;
+}
+
+/* two replicas of n random keys, one of which then takes a few changes.
+ * the plain trees are diffed by walking both whole. */
+void merkleBench (int n, int changes) {
+  byte_t* keys = malloc((word_t)n * 8);
+  word_t x = 88172645463325252UL;
+  int i, j, pass, found;
+  double start;
+  Art *a, *b;
+
+  for (i = 0; i < n * 8; i++) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    keys[i] = (byte_t)x;
+  }
+  for (pass = 0; pass < 2; pass++) {
+    a = pass ? artNewMerkle() : artNew();
+    b = pass ? artNewMerkle() : artNew();
+    start = wallClock();
+    for (i = 0; i < n; i++)
+      artPut(a, keys + i * 8, 8, i + 1);
+    printf("%s: inserted %d keys in %f.\n", pass ? "merkle" : "plain", n, wallClock() - start);
+    for (i = n - 1; i >= 0; i--)
+      artPut(b, keys + i * 8, 8, i + 1);
+    for (i = 0; i < changes; i++) {
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+      j = x % n;
+      if (x & 256) artRemove(b, keys + j * 8, 8);
+      else artPut(b, keys + j * 8, 8, x);
+    }
+    found = 0;
+    start = wallClock();
+    artDiff(a, b, merkleCount, &found);
+    printf("  diffed in %f, %d keys differ.\n", wallClock() - start, found);
+    if (pass) printf("  root hashes %s.\n", artRootHash(a) == artRootHash(b) ? "equal" : "differ");
+    artFree(a);
+    artFree(b);
+  }
+  free(keys);
+}
+
+/* getWord and artPut a line at a time, against artLoadLines */
+void linesBench (char* file) {
+  FILE* in = fopen(file, "r");
+  byte_t* word;
+  int n = 0;
+  word_t line = 0;
+  double start;
+  Art* d = artNew();
+
+  start = wallClock();
+  while ((word = getWord(in))) {
+    artPut(d, word, strlen((char *)word), ++line);
+    free(word);
+    n++;
+  }
+  fclose(in);
+  printf("getWord: put %d keys in %f, %lu bytes.\n", n, wallClock() - start, d->bytes);
+  artFree(d);
+
+  d = artNew();
+  start = wallClock();
+  n = artLoadLines(d, file, NULL, NULL);
+  printf("artLoadLines: put %d keys in %f, %lu bytes.\n", n, wallClock() - start, d->bytes);
+  artFree(d);
+}
+
 int main (int argc, char** argv) {
   word_t val;
   Art* d = artNew();
@@ -125,6 +1015,100 @@ int main (int argc, char** argv) {
   if (argc < 2) {
     return 1;
   }
+
+  if (!strcmp(argv[1], "-long")) {
+    longKeyBench(d);
+    return 0;
+  }
+
+  if (!strcmp(argv[1], "-scan") && argc > 3) {
+    scanBench(argv[2], atoi(argv[3]));
+    return 0;
+  }
+
+  if (!strcmp(argv[1], "-build") && argc > 3) {
+    buildBench(argv[2], atoi(argv[3]));
+    return 0;
+  }
+
+  if (!strcmp(argv[1], "-optimize") && argc > 2) {
+    optimizeBench(argv[2]);
+    return 0;
+  }
+
+  if (!strcmp(argv[1], "-fuzzy") && argc > 2) {
+    fuzzyBench(argv[2]);
+    return 0;
+  }
+
+  if (!strcmp(argv[1], "-topk") && argc > 2) {
+    topBench(argv[2]);
+    return 0;
+  }
+
+  if (!strcmp(argv[1], "-route") && argc > 2) {
+    routeBench(atoi(argv[2]));
+    return 0;
+  }
+
+  if (!strcmp(argv[1], "-remove") && argc > 2) {
+    removeBench(argv[2]);
+    return 0;
+  }
+
+  if (!strcmp(argv[1], "-fixed") && argc > 2) {
+    fixedBench(atoi(argv[2]));
+    return 0;
+  }
+
+  if (!strcmp(argv[1], "-buffer") && argc > 3) {
+    bufferBench(atoi(argv[2]), atoi(argv[3]));
+    return 0;
+  }
+
+  if (!strcmp(argv[1], "-freeze") && argc > 3) {
+    freezeBench(argv[2], argv[3]);
+    return 0;
+  }
+
+  if (!strcmp(argv[1], "-filter") && argc > 2) {
+    filterBench(argv[2]);
+    return 0;
+  }
+
+  if (!strcmp(argv[1], "-feed") && argc > 3) {
+    feedBench(argv[2], atoi(argv[3]));
+    return 0;
+  }
+
+  if (!strcmp(argv[1], "-cache") && argc > 3) {
+    cacheBench(argv[2], atoi(argv[3]));
+    return 0;
+  }
+
+  if (!strcmp(argv[1], "-finger") && argc > 2) {
+    fingerBench(atoi(argv[2]));
+    return 0;
+  }
+
+  if (!strcmp(argv[1], "-merkle") && argc > 3) {
+    merkleBench(atoi(argv[2]), atoi(argv[3]));
+    return 0;
+  }
+  if (!strcmp(argv[1], "-lines") && argc > 2) {
+    linesBench(argv[2]);
+    return 0;
+  }
+
+  if (!strcmp(argv[1], "-codec") && argc > 3) {
+    codecBench(argv[2], argv[3]);
+    return 0;
+  }
+
+  if (!strcmp(argv[1], "-join") && argc > 3) {
+    joinBench(argv[2], argv[3]);
+    return 0;
+  }
   
   wordBench(d, argc, argv);
   puts("Press enter to continue...");
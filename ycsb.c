@@ -0,0 +1,336 @@
+/* YCSB style workload driver
+ *   loads a key source, then runs one of the standard A-F operation
+ *   mixes on several threads against a single tree behind a rwlock.
+ *   reports throughput and a latency histogram per operation type.
+ *
+ *   ycsb [-w A-F] [-d uniform|zipfian|latest] [-k file|int]
+ *        [-t threads] [-n ops] [-r records] [-m read,update,insert,scan,rmw,delete]
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <math.h>
+#include <pthread.h>
+
+#include "bench.h"
+
+#define OP_READ   0
+#define OP_UPDATE 1
+#define OP_INSERT 2
+#define OP_SCAN   3
+#define OP_RMW    4
+#define OP_DELETE 5
+#define OPS       6
+
+#define DIST_UNIFORM 0
+#define DIST_ZIPFIAN 1
+#define DIST_LATEST  2
+
+#define SCAN_MAX     100
+#define SCAN_PREFIX  3
+#define ZIPF_THETA   0.99
+
+static const char* opNames[OPS] = { "read", "update", "insert", "scan", "rmw", "delete" };
+
+typedef struct {
+  byte_t**         keys;
+  int*             lens;
+  int              count;
+  int              cap;
+  int              genInts;
+  Art*             art;
+  pthread_rwlock_t lock;
+  int              mix[OPS];
+  int              dist;
+  int              ops;
+  double           zetan;
+  double           zeta2;
+  double           alpha;
+  double           eta;
+  int              zipfItems;
+} workload;
+
+typedef struct {
+  workload*  w;
+  word_t     rng;
+  int        ops;
+  histogram  hist[OPS];
+  pthread_t  thread;
+} worker;
+
+static double nextDouble (word_t* s) {
+  return (nextRandom(s) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* zipfian ranks as in Gray et al., "Quickly Generating Billion-Record
+ * Synthetic Databases", the generator YCSB itself uses */
+static void zipfInit (workload* w, int items) {
+  double z = 0;
+  int i;
+  for (i = 1; i <= items; i++)
+    z += 1 / pow(i, ZIPF_THETA);
+  w->zipfItems = items;
+  w->zetan = z;
+  w->zeta2 = 1 + 1 / pow(2, ZIPF_THETA);
+  w->alpha = 1 / (1 - ZIPF_THETA);
+  w->eta = (1 - pow(2.0 / items, 1 - ZIPF_THETA)) / (1 - w->zeta2 / z);
+}
+
+static int zipfNext (workload* w, word_t* s) {
+  double u = nextDouble(s), uz = u * w->zetan;
+  if (uz < 1) return 0;
+  if (uz < w->zeta2) return 1;
+  return (int)(w->zipfItems * pow(w->eta * u - w->eta + 1, w->alpha));
+}
+
+/* index of an existing record. zipfian ranks are scattered over the key
+ * space so the hot keys are not neighbours; latest favours new records. */
+static int pickKey (workload* w, word_t* s, int count) {
+  int r;
+  switch (w->dist) {
+  case DIST_ZIPFIAN:
+    return (int)(fnv(zipfNext(w, s)) % count);
+  case DIST_LATEST:
+    r = zipfNext(w, s);
+    return r < count ? count - 1 - r : (int)(nextRandom(s) % count);
+  default:
+    return (int)(nextRandom(s) % count);
+  }
+}
+
+static void histPrint (const char* name, histogram* h) {
+  word_t n;
+  int i, j;
+  if (!h->count) return;
+  printf("%-7s %9lu ops  avg %6luns  p50 %6luns  p95 %6luns  p99 %6luns  p99.9 %7luns  max %8luns\n",
+    name, h->count, h->total / h->count, histPercentile(h, 0.5), histPercentile(h, 0.95),
+    histPercentile(h, 0.99), histPercentile(h, 0.999), h->max);
+  /* one line per power of two, so the shape fits on a terminal */
+  printf("       ");
+  for (i = 0; i < HIST_BUCKETS; i += HIST_SUB) {
+    for (n = 0, j = i; j < i + HIST_SUB; j++) n += h->buckets[j];
+    if (n) printf(" <%lu:%lu", histBound(i + HIST_SUB - 1), n);
+  }
+  printf("\n");
+}
+
+static int scanVisitor (void* ctx, byte_t* k, int l, word_t v) {
+  return --*(int *)ctx <= 0;
+}
+
+/* writers append under the write lock, so count only moves there */
+static int addKey (workload* w) {
+  byte_t* k;
+  word_t x;
+  int i;
+  if (w->count == w->cap) return -1;
+  if (w->genInts) {
+    k = malloc(8);
+    x = fnv(w->count);
+    for (i = 0; i < 8; i++) k[i] = (byte_t)(x >> (56 - 8 * i));
+    w->keys[w->count] = k;
+    w->lens[w->count] = 8;
+  }
+  return w->count++;
+}
+
+static void* runWorker (void* arg) {
+  worker* t = arg;
+  workload* w = t->w;
+  double start;
+  word_t v;
+  int i, op, r, n, idx, len;
+
+  for (i = 0; i < t->ops; i++) {
+    r = (int)(nextRandom(&t->rng) % 100);
+    for (op = 0; op < OPS - 1 && r >= w->mix[op]; op++)
+      r -= w->mix[op];
+
+    start = wallClock();
+    switch (op) {
+    case OP_READ:
+      pthread_rwlock_rdlock(&w->lock);
+      idx = pickKey(w, &t->rng, w->count);
+      artGet(w->art, w->keys[idx], w->lens[idx]);
+      pthread_rwlock_unlock(&w->lock);
+    break;
+    case OP_SCAN:
+      /* artScan walks a prefix, so scans take the first bytes of the
+       * chosen key and stop after a random count */
+      pthread_rwlock_rdlock(&w->lock);
+      idx = pickKey(w, &t->rng, w->count);
+      n = 1 + (int)(nextRandom(&t->rng) % SCAN_MAX);
+      len = w->lens[idx] < SCAN_PREFIX ? w->lens[idx] : SCAN_PREFIX;
+      artScan(w->art, w->keys[idx], len, scanVisitor, &n);
+      pthread_rwlock_unlock(&w->lock);
+    break;
+    case OP_UPDATE:
+      pthread_rwlock_wrlock(&w->lock);
+      idx = pickKey(w, &t->rng, w->count);
+      artPut(w->art, w->keys[idx], w->lens[idx], nextRandom(&t->rng) | 1);
+      pthread_rwlock_unlock(&w->lock);
+    break;
+    case OP_RMW:
+      pthread_rwlock_wrlock(&w->lock);
+      idx = pickKey(w, &t->rng, w->count);
+      v = artGet(w->art, w->keys[idx], w->lens[idx]);
+      artPut(w->art, w->keys[idx], w->lens[idx], (v + 2) | 1);
+      pthread_rwlock_unlock(&w->lock);
+    break;
+    case OP_INSERT:
+      pthread_rwlock_wrlock(&w->lock);
+      idx = addKey(w);
+      if (idx < 0) idx = pickKey(w, &t->rng, w->count);
+      artPut(w->art, w->keys[idx], w->lens[idx], nextRandom(&t->rng) | 1);
+      pthread_rwlock_unlock(&w->lock);
+    break;
+    case OP_DELETE:
+      pthread_rwlock_wrlock(&w->lock);
+      idx = pickKey(w, &t->rng, w->count);
+      artRemove(w->art, w->keys[idx], w->lens[idx]);
+      pthread_rwlock_unlock(&w->lock);
+    break;
+    }
+    histAdd(&t->hist[op], (word_t)((wallClock() - start) * 1e9));
+  }
+  return NULL;
+}
+
+static void setMix (int* mix, int read, int update, int insert, int scan, int rmw, int del) {
+  mix[OP_READ] = read;
+  mix[OP_UPDATE] = update;
+  mix[OP_INSERT] = insert;
+  mix[OP_SCAN] = scan;
+  mix[OP_RMW] = rmw;
+  mix[OP_DELETE] = del;
+}
+
+/* the standard mixes and their request distributions */
+static int setWorkload (workload* w, char name) {
+  switch (name) {
+  case 'A': setMix(w->mix, 50, 50, 0, 0, 0, 0);  w->dist = DIST_ZIPFIAN; break;
+  case 'B': setMix(w->mix, 95, 5, 0, 0, 0, 0);   w->dist = DIST_ZIPFIAN; break;
+  case 'C': setMix(w->mix, 100, 0, 0, 0, 0, 0);  w->dist = DIST_ZIPFIAN; break;
+  case 'D': setMix(w->mix, 95, 0, 5, 0, 0, 0);   w->dist = DIST_LATEST;  break;
+  case 'E': setMix(w->mix, 0, 0, 5, 95, 0, 0);   w->dist = DIST_ZIPFIAN; break;
+  case 'F': setMix(w->mix, 50, 0, 0, 0, 50, 0);  w->dist = DIST_ZIPFIAN; break;
+  default: return 0;
+  }
+  return 1;
+}
+
+static void usage (void) {
+  fprintf(stderr, "usage: ycsb [-w A-F] [-d uniform|zipfian|latest] [-k file|int]\n"
+                  "            [-t threads] [-n ops] [-r records]\n"
+                  "            [-m read,update,insert,scan,rmw,delete]\n");
+  exit(1);
+}
+
+int main (int argc, char** argv) {
+  workload w;
+  worker* workers;
+  histogram total[OPS];
+  char* source = "words.txt";
+  char *dist = NULL, name = 'A';
+  int threads = 1, ops = 1000000, records = -1, i, j, m[OPS], custom = 0, loaded;
+  double start, elapsed;
+  word_t done = 0;
+  FILE* in;
+
+  memset(&w, 0, sizeof(w));
+  for (i = 1; i < argc; i++) {
+    if (i + 1 >= argc) usage();
+    if (!strcmp(argv[i], "-w")) name = argv[++i][0];
+    else if (!strcmp(argv[i], "-d")) dist = argv[++i];
+    else if (!strcmp(argv[i], "-k")) source = argv[++i];
+    else if (!strcmp(argv[i], "-t")) threads = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-n")) ops = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-r")) records = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-m")) {
+      custom = sscanf(argv[++i], "%d,%d,%d,%d,%d,%d", &m[0], &m[1], &m[2], &m[3], &m[4], &m[5]) == OPS;
+      if (!custom) usage();
+    }
+    else usage();
+  }
+  if (!setWorkload(&w, name) || threads < 1 || ops < 1) usage();
+  if (custom) {
+    for (i = 0, j = 0; i < OPS; i++) j += m[i];
+    if (j != 100) usage();
+    memcpy(w.mix, m, sizeof(m));
+  }
+  if (dist) {
+    if (!strcmp(dist, "uniform")) w.dist = DIST_UNIFORM;
+    else if (!strcmp(dist, "zipfian")) w.dist = DIST_ZIPFIAN;
+    else if (!strcmp(dist, "latest")) w.dist = DIST_LATEST;
+    else usage();
+  }
+
+  /* files keep their last fifth back for inserts. generated integer
+   * keys are 8 byte big-endian scrambled counters, made on demand. */
+  if (!strcmp(source, "int")) {
+    w.genInts = 1;
+    loaded = records > 0 ? records : 1000000;
+    w.cap = loaded + ops;
+    w.keys = malloc(w.cap * sizeof(byte_t*));
+    w.lens = malloc(w.cap * sizeof(int));
+    for (i = 0; i < loaded; i++) addKey(&w);
+  } else {
+    if (!(in = fopen(source, "r"))) {
+      fprintf(stderr, "cannot open %s\n", source);
+      return 1;
+    }
+    while (1) {
+      if (w.count == w.cap) {
+        w.cap = w.cap ? w.cap * 2 : 1024;
+        w.keys = realloc(w.keys, w.cap * sizeof(byte_t*));
+        w.lens = realloc(w.lens, w.cap * sizeof(int));
+      }
+      if (!(w.keys[w.count] = readLine(in, &w.lens[w.count]))) break;
+      w.count++;
+    }
+    fclose(in);
+    w.cap = w.count;
+    loaded = w.count - w.count / 5;
+    if (records > 0 && records < loaded) loaded = records;
+  }
+  w.count = loaded;
+  if (!loaded) usage();
+
+  w.art = artNew();
+  for (i = 0; i < loaded; i++)
+    artPut(w.art, w.keys[i], w.lens[i], (word_t)i + 1);
+  zipfInit(&w, loaded);
+  pthread_rwlock_init(&w.lock, NULL);
+
+  workers = calloc(threads, sizeof(worker));
+  for (i = 0; i < threads; i++) {
+    workers[i].w = &w;
+    workers[i].rng = fnv(i + 1) | 1;
+    workers[i].ops = ops / threads + (i < ops % threads);
+  }
+  start = wallClock();
+  for (i = 1; i < threads; i++)
+    pthread_create(&workers[i].thread, NULL, runWorker, &workers[i]);
+  runWorker(&workers[0]);
+  for (i = 1; i < threads; i++)
+    pthread_join(workers[i].thread, NULL);
+  elapsed = wallClock() - start;
+
+  memset(total, 0, sizeof(total));
+  for (i = 0; i < threads; i++) {
+    for (j = 0; j < OPS; j++)
+      histMerge(&total[j], &workers[i].hist[j]);
+  }
+  for (j = 0; j < OPS; j++) done += total[j].count;
+
+  printf("workload %c, %s keys, %s, %d records, %d threads\n", name, source,
+    w.dist == DIST_UNIFORM ? "uniform" : w.dist == DIST_LATEST ? "latest" : "zipfian",
+    loaded, threads);
+  printf("%lu ops in %.3fs, %.0f ops/s\n", done, elapsed, done / elapsed);
+  for (j = 0; j < OPS; j++)
+    histPrint(opNames[j], &total[j]);
+
+  pthread_rwlock_destroy(&w.lock);
+  free(workers);
+  return 0;
+}